@@ -0,0 +1,239 @@
+#include "binary.h"
+
+#include <algorithm>
+
+// Nibble code of every board char; 0xF for chars that are neither a piece nor a space.
+constexpr std::array<std::uint8_t, 256> makeNibbleCodes() {
+  std::array<std::uint8_t, 256> codes{};
+  for (int c = 0; c < 256; ++c) {
+    const int index = pieceIndex(static_cast<char>(c));
+    codes[c] = index >= 0 ? index + 1 : c == ' ' ? 0 : 0xF;
+  }
+  return codes;
+}
+
+constexpr std::array<std::uint8_t, 256> NibbleCodes = makeNibbleCodes();
+constexpr std::array<char, 16> NibbleChars = {' ', 'P', 'N', 'B', 'R', 'Q', 'K', 'p',
+                                              'n', 'b', 'r', 'q', 'k', '?', '?', '?'};
+
+bool packBoard(const char* squares, PackedBoard& packed) {
+  bool valid = true;
+  for (std::size_t index = 0; index < PackedBoardBytes; ++index) {
+    const std::uint8_t low = NibbleCodes[static_cast<unsigned char>(squares[2 * index])];
+    const std::uint8_t high = NibbleCodes[static_cast<unsigned char>(squares[2 * index + 1])];
+    valid &= low != 0xF && high != 0xF;
+    packed[index] = low | high << 4;
+  }
+  return valid;
+}
+
+bool unpackBoard(const std::uint8_t* packed, char* squares) {
+  bool valid = true;
+  for (std::size_t index = 0; index < PackedBoardBytes; ++index) {
+    squares[2 * index] = NibbleChars[packed[index] & 0xF];
+    squares[2 * index + 1] = NibbleChars[packed[index] >> 4];
+    valid &= squares[2 * index] != '?' && squares[2 * index + 1] != '?';
+  }
+  return valid;
+}
+
+const std::uint8_t* asBytes(std::string_view data) { return reinterpret_cast<const std::uint8_t*>(data.data()); }
+
+std::uint16_t readUint16(const std::uint8_t* data) { return static_cast<std::uint16_t>(data[0] | data[1] << 8); }
+
+void appendUint16(std::string& out, std::uint16_t value) {
+  out += static_cast<char>(value & 0xFF);
+  out += static_cast<char>(value >> 8);
+}
+
+bool isBinaryInput(LineReader& in) {
+  const std::string_view header = in.peek(BinaryHeaderBytes);
+  return header.size() == BinaryHeaderBytes && std::equal(BinaryMagic.begin(), BinaryMagic.end(), header.begin());
+}
+
+// Checks and skips the header.
+bool readHeader(LineReader& in) {
+  if (!isBinaryInput(in) || readUint16(asBytes(in.peek(BinaryHeaderBytes)) + 4) != BinaryVersion) {
+    return false;
+  }
+  in.skip(BinaryHeaderBytes);
+  return true;
+}
+
+// Visits the records after the header: onBoard(const std::uint8_t*), onMove(Move) and onText(std::string_view).
+// False if a record is cut short or has an unknown tag.
+template <typename OnBoard, typename OnMove, typename OnText>
+bool forEachRecord(LineReader& in, OnBoard onBoard, OnMove onMove, OnText onText) {
+  for (std::string_view tag; !(tag = in.peek(1)).empty();) {
+    switch (static_cast<RecordTag>(tag[0])) {
+      case RecordTag::Board: {
+        const std::string_view record = in.peek(1 + PackedBoardBytes);
+        if (record.size() < 1 + PackedBoardBytes) {
+          return false;
+        }
+        onBoard(asBytes(record) + 1);
+        in.skip(record.size());
+        break;
+      }
+      case RecordTag::Moves: {
+        const std::string_view head = in.peek(2);
+        if (head.size() < 2 || head[1] == 0) {
+          return false;
+        }
+        const std::size_t count = static_cast<std::uint8_t>(head[1]);
+        const std::string_view record = in.peek(2 + 2 * count);
+        if (record.size() < 2 + 2 * count) {
+          return false;
+        }
+        for (std::size_t index = 0; index < count; ++index) {
+          onMove(static_cast<Move>(readUint16(asBytes(record) + 2 + 2 * index)));
+        }
+        in.skip(record.size());
+        break;
+      }
+      case RecordTag::Text: {
+        const std::string_view head = in.peek(3);
+        if (head.size() < 3) {
+          return false;
+        }
+        const std::size_t length = readUint16(asBytes(head) + 1);
+        const std::string_view record = in.peek(3 + length);
+        if (record.size() < 3 + length) {
+          return false;
+        }
+        onText(record.substr(3));
+        in.skip(record.size());
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+bool runBinary(LineReader& in, Session& session, OutputWriter& out) {
+  if (!readHeader(in)) {
+    return false;
+  }
+  Position& position = session.getPosition();
+  return forEachRecord(
+      in,
+      [&](const std::uint8_t* packed) {
+        std::array<char, 64> squares;
+        unpackBoard(packed, squares.data());
+        const Verdict verdict = position.loadBoard(std::string_view(squares.data(), squares.size()));
+        session.appendResult(CommandKind::Board, verdict, out.buffer());
+        out.commit();
+      },
+      [&](Move move) {
+        session.appendResult(CommandKind::Move, position.playMove(move), out.buffer());
+        out.commit();
+      },
+      [&](std::string_view text) {
+        session.execute(text, out.buffer());
+        if (text == "print") {
+          out.push();
+        } else {
+          out.commit();
+        }
+      });
+}
+
+// Keeps the converter's copy of the game in step with a text line; perft and go are skipped as they change
+// nothing and may run for a long time.
+void replay(Session& session, std::string_view line) {
+  const bool go = line.rfind("go", 0) == 0 && (line.size() == 2 || line[2] == ' ');
+  if (line.rfind("perft", 0) != 0 && !go) {
+    std::string ignored;
+    session.execute(line, ignored);
+  }
+}
+
+void convertToBinary(LineReader& in, OutputWriter& out) {
+  std::string header(BinaryMagic.begin(), BinaryMagic.end());
+  appendUint16(header, BinaryVersion);
+  appendUint16(header, 0);
+  out.write(header);
+
+  Session session;
+  Position& position = session.getPosition();
+  // Moves of the current run, written once the run ends or is full since the record leads with its count.
+  std::string run;
+  std::size_t runMoves = 0;
+  const auto writeRun = [&] {
+    if (runMoves == 0) {
+      return;
+    }
+    std::string& record = out.buffer();
+    record += static_cast<char>(RecordTag::Moves);
+    record += static_cast<char>(runMoves);
+    record += run;
+    out.commit();
+    run.clear();
+    runMoves = 0;
+  };
+
+  std::string_view line;
+  while (in.next(line)) {
+    PackedBoard packed;
+    Move move;
+    if (line[0] == 'M' && position.parseMove(line.substr(1), move) && position.playMove(move) != Verdict::Invalid) {
+      appendUint16(run, move);
+      if (++runMoves == MaxRunMoves) {
+        writeRun();
+      }
+      continue;
+    }
+    writeRun();
+    std::string& record = out.buffer();
+    if (line[0] == 'B' && isValidBoardString(line.substr(1)) && packBoard(line.data() + 1, packed)) {
+      position.loadBoard(line.substr(1));
+      record += static_cast<char>(RecordTag::Board);
+      record.append(packed.begin(), packed.end());
+    } else {
+      const std::string_view text = line.substr(0, 0xFFFF);
+      replay(session, text);
+      record += static_cast<char>(RecordTag::Text);
+      appendUint16(record, static_cast<std::uint16_t>(text.size()));
+      record += text;
+    }
+    out.commit();
+  }
+  writeRun();
+}
+
+bool convertToText(LineReader& in, OutputWriter& out) {
+  if (!readHeader(in)) {
+    return false;
+  }
+  Session session;
+  Position& position = session.getPosition();
+  return forEachRecord(
+      in,
+      [&](const std::uint8_t* packed) {
+        std::array<char, 64> squares;
+        unpackBoard(packed, squares.data());
+        position.loadBoard(std::string_view(squares.data(), squares.size()));
+        std::string& line = out.buffer();
+        line += 'B';
+        line.append(squares.begin(), squares.end());
+        line += '\n';
+        out.commit();
+      },
+      [&](Move move) {
+        std::string& line = out.buffer();
+        line += 'M';
+        line += moveToText(position.getBoard(), move);
+        line += '\n';
+        position.playMove(move);
+        out.commit();
+      },
+      [&](std::string_view text) {
+        replay(session, text);
+        std::string& line = out.buffer();
+        line += text;
+        line += '\n';
+        out.commit();
+      });
+}
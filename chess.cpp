@@ -0,0 +1,1217 @@
+#include "chess.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <thread>
+
+// Square-by-square ray walk; only used to fill the sliding-attack tables below.
+constexpr Bitboard walkRays(int square, Bitboard occupied, const Directions& directions) {
+  Bitboard attacks = 0;
+  for (const auto& direction : directions) {
+    int rank = square / 8 + direction[0];
+    int file = square % 8 + direction[1];
+    while (rank >= 0 && rank < 8 && file >= 0 && file < 8) {
+      const Bitboard bit = squareBit(toSquare(rank, file));
+      attacks |= bit;
+      if (occupied & bit) {
+        break;
+      }
+      rank += direction[0];
+      file += direction[1];
+    }
+  }
+  return attacks;
+}
+
+// Squares whose occupancy can cut a ray short. The last square of a ray never blocks anything.
+constexpr Bitboard blockerMask(int square, const Directions& directions) {
+  Bitboard mask = 0;
+  for (const auto& direction : directions) {
+    int rank = square / 8 + direction[0];
+    int file = square % 8 + direction[1];
+    while (rank + direction[0] >= 0 && rank + direction[0] < 8 && file + direction[1] >= 0 &&
+           file + direction[1] < 8) {
+      mask |= squareBit(toSquare(rank, file));
+      rank += direction[0];
+      file += direction[1];
+    }
+  }
+  return mask;
+}
+
+// Found offline by a fixed-seed random search for this square numbering (a8 = 0), one per square,
+// each mapping every blocker subset of blockerMask() to a collision-free index of popcount(mask) bits.
+constexpr std::array<Bitboard, 64> RookMagics = {
+    0x1080004008801020ULL, 0x0840092002C03000ULL, 0x1900200010400900ULL, 0x0880100008000480ULL,
+    0x4200100420080200ULL, 0x8100020100080400ULL, 0x0200040110886200ULL, 0x0200008040220411ULL,
+    0x0404800084400220ULL, 0x0000401000402000ULL, 0x0086001081220440ULL, 0x0408800800100280ULL,
+    0x000A001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL, 0x0442000102105084ULL,
+    0x9080010020804100ULL, 0x0040404000201009ULL, 0x0000808010002009ULL, 0x2200090021D00100ULL,
+    0x0008008008040080ULL, 0x0004004002010040ULL, 0x0011040008015042ULL, 0x00000A0001768104ULL,
+    0x0000800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL, 0x1000100080080080ULL,
+    0x0442000A00049020ULL, 0x2100040080020080ULL, 0x0800120400900148ULL, 0x0010040A00128541ULL,
+    0x2800804000800030ULL, 0x1010002000400041ULL, 0x4000200011004100ULL, 0x0610008410800800ULL,
+    0x0400802402800800ULL, 0xC100020080800400ULL, 0x0002000802000401ULL, 0x0182085882000401ULL,
+    0x0220204000808000ULL, 0x2860100040024022ULL, 0x0001002004110040ULL, 0x99101042000A0020ULL,
+    0x0004080004008080ULL, 0x0010040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+    0x0088403882010200ULL, 0x0820400080210100ULL, 0x0110910040A00300ULL, 0x0801100280080480ULL,
+    0x0242009008200600ULL, 0x1002000489500200ULL, 0x0040800200010080ULL, 0x0091800041000080ULL,
+    0x0000209300488001ULL, 0x04C1002414824001ULL, 0x020020000B001041ULL, 0x7000100004200901ULL,
+    0x8002002004100802ULL, 0x30010002084C0007ULL, 0x0888221800813004ULL, 0x4000002840840112ULL,
+};
+
+constexpr std::array<Bitboard, 64> BishopMagics = {
+    0xA010041108003100ULL, 0x006082020A002900ULL, 0x6810010619200000ULL, 0x08281A0520000408ULL,
+    0x0001104001000400ULL, 0x0018901008048400ULL, 0x00040A0210245280ULL, 0x000200210808A402ULL,
+    0x9140048410821200ULL, 0x0800091010820041ULL, 0x20504804832202C0ULL, 0x0100091401081000ULL,
+    0x8021011140000012ULL, 0x0810020804450400ULL, 0x208B0542109008A2ULL, 0x0080084A08040204ULL,
+    0x0040E2A80811244CULL, 0x2505022008008108ULL, 0x0430220100420040ULL, 0x010A040420220040ULL,
+    0x1105000290400000ULL, 0x0093001200822120ULL, 0x4000A62048043004ULL, 0x280120048A015004ULL,
+    0x006090002A020814ULL, 0x44042000240800D0ULL, 0x01102800040A4400ULL, 0x1004080080220040ULL,
+    0x0001001011004024ULL, 0x0010044000805040ULL, 0x0914041200820100ULL, 0x0004821012821480ULL,
+    0x0024040500C05021ULL, 0x0088611002080200ULL, 0x0116080A00040020ULL, 0x4000020080080080ULL,
+    0x2450450140840040ULL, 0x0000880201484100ULL, 0x0222020404020092ULL, 0x8081110600002E00ULL,
+    0x2842101105000801ULL, 0x1100809008001025ULL, 0x00020202221C0400ULL, 0x0422014022009020ULL,
+    0x0210046102100C00ULL, 0xC004008082029102ULL, 0x00AA461801101200ULL, 0x0404080080201108ULL,
+    0x020542108C205002ULL, 0x0410544804100100ULL, 0x0040910841100000ULL, 0x0400200042021100ULL,
+    0x00004204850400C0ULL, 0x0200100410A42102ULL, 0x1040020801210102ULL, 0x0805040410420000ULL,
+    0x2884804130100200ULL, 0x800C262201242000ULL, 0x1058000194108800ULL, 0x0014221054420204ULL,
+    0x0104000012A02200ULL, 0x0200881003300100ULL, 0x0140400202840100ULL, 0x0402020801010201ULL,
+};
+
+const bool UsePext = cpuHasPext();
+
+#if defined(__x86_64__)
+inline bool cpuHasAvx2() { return __builtin_cpu_supports("avx2"); }
+#else
+inline bool cpuHasAvx2() { return false; }
+#endif
+
+const bool UseAvx2 = cpuHasAvx2();
+
+SlidingAttacks::SlidingAttacks(const Directions& directions, const std::array<Bitboard, 64>& magics) {
+  std::size_t size = 0;
+  for (int square = 0; square < 64; ++square) {
+    size += std::size_t{1} << __builtin_popcountll(blockerMask(square, directions));
+  }
+  table.resize(size);
+
+  std::size_t offset = 0;
+  for (int square = 0; square < 64; ++square) {
+    Entry& entry = entries[square];
+    entry.mask = blockerMask(square, directions);
+    entry.magic = magics[square];
+    entry.shift = 64 - __builtin_popcountll(entry.mask);
+    entry.attacks = table.data() + offset;
+
+    Bitboard subset = 0;
+    do {
+      entry.attacks[index(entry, subset)] = walkRays(square, subset, directions);
+      subset = (subset - entry.mask) & entry.mask;
+    } while (subset);
+    offset += std::size_t{1} << __builtin_popcountll(entry.mask);
+  }
+}
+
+const SlidingAttacks RookAttacks(RookDirections, RookMagics);
+const SlidingAttacks BishopAttacks(BishopDirections, BishopMagics);
+
+// The chars of the first 13 board slots: the twelve pieces in pieceIndex() order, then the empty square.
+constexpr std::array<char, 13> SlotChars = {'P', 'N', 'B', 'R', 'Q', 'K', 'p', 'n', 'b', 'r', 'q', 'k', ' '};
+
+// Sorts 64 board chars into one mask per board slot; false if any char has no slot below BlockerSlot.
+bool classifySquaresScalar(const char* text, std::array<Bitboard, 14>& slots) {
+  slots.fill(0);
+  for (int square = 0; square < 64; ++square) {
+    slots[boardSlot(text[square])] |= squareBit(square);
+  }
+  return !slots[BlockerSlot];
+}
+
+#if defined(__x86_64__)
+// SSE2 is part of x86-64, so this is the baseline there: four 16-byte compares per slot char.
+bool classifySquaresSse2(const char* text, std::array<Bitboard, 14>& slots) {
+  __m128i chunks[4];
+  for (int chunk = 0; chunk < 4; ++chunk) {
+    chunks[chunk] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + 16 * chunk));
+  }
+  Bitboard known = 0;
+  for (int slot = 0; slot < BlockerSlot; ++slot) {
+    const __m128i wanted = _mm_set1_epi8(SlotChars[slot]);
+    Bitboard mask = 0;
+    for (int chunk = 0; chunk < 4; ++chunk) {
+      const int matches = _mm_movemask_epi8(_mm_cmpeq_epi8(chunks[chunk], wanted));
+      mask |= static_cast<Bitboard>(static_cast<std::uint16_t>(matches)) << (16 * chunk);
+    }
+    slots[slot] = mask;
+    known |= mask;
+  }
+  slots[BlockerSlot] = ~known;
+  return !slots[BlockerSlot];
+}
+
+__attribute__((target("avx2"))) bool classifySquaresAvx2(const char* text, std::array<Bitboard, 14>& slots) {
+  const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text));
+  const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + 32));
+  Bitboard known = 0;
+  for (int slot = 0; slot < BlockerSlot; ++slot) {
+    const __m256i wanted = _mm256_set1_epi8(SlotChars[slot]);
+    const std::uint32_t lowMatches = _mm256_movemask_epi8(_mm256_cmpeq_epi8(low, wanted));
+    const std::uint32_t highMatches = _mm256_movemask_epi8(_mm256_cmpeq_epi8(high, wanted));
+    const Bitboard mask = lowMatches | static_cast<Bitboard>(highMatches) << 32;
+    slots[slot] = mask;
+    known |= mask;
+  }
+  slots[BlockerSlot] = ~known;
+  return !slots[BlockerSlot];
+}
+#endif
+
+bool classifySquares(const char* text, std::array<Bitboard, 14>& slots) {
+#if defined(__x86_64__)
+  return UseAvx2 ? classifySquaresAvx2(text, slots) : classifySquaresSse2(text, slots);
+#else
+  return classifySquaresScalar(text, slots);
+#endif
+}
+
+bool ChessBoard::loadSquares(const char* text) {
+  std::array<Bitboard, 14> slots;
+  if (!classifySquares(text, slots)) {
+    return false;
+  }
+  for (int rank = 0; rank < 8; ++rank) {
+    std::copy(text + 8 * rank, text + 8 * rank + 8, squares[rank].begin());
+  }
+  for (int square = 0; square < 64; ++square) {
+    mailbox[square] = static_cast<std::uint8_t>(boardSlot(text[square]));
+  }
+  pieces = slots;
+  colors = {slots[0] | slots[1] | slots[2] | slots[3] | slots[4] | slots[5],
+            slots[6] | slots[7] | slots[8] | slots[9] | slots[10] | slots[11], slots[EmptySlot]};
+  occupied = ~slots[EmptySlot];
+
+  key = Zobrist.castling[castlingRights] ^ (epSquare >= 0 ? Zobrist.enPassantFile[epSquare % 8] : 0);
+  for (int slot = 0; slot < EmptySlot; ++slot) {
+    for (Bitboard bits = slots[slot]; bits;) {
+      key ^= Zobrist.squares[slot][popLowestSquare(bits)];
+    }
+  }
+  return true;
+}
+
+// 64 chars for the squares, then at most some whitespace, such as the '\r' of a CRLF line end.
+bool hasBoardLength(std::string_view squares) {
+  return squares.size() >= 64 && std::all_of(squares.begin() + 64, squares.end(), [](char c) {
+           return std::isspace(static_cast<unsigned char>(c));
+         });
+}
+
+bool isValidBoardString(std::string_view squares) {
+  std::array<Bitboard, 14> slots;
+  return hasBoardLength(squares) && classifySquares(squares.data(), slots);
+}
+
+void PositionBatch::add(const ChessBoard& board) {
+  for (int slot = 0; slot < EmptySlot; ++slot) {
+    pieces[slot].push_back(board.pieces[slot]);
+  }
+  occupied.push_back(board.occupied);
+}
+
+bool PositionBatch::add(const char* squares) {
+  std::array<Bitboard, 14> slots;
+  const bool valid = classifySquares(squares, slots);
+  for (int slot = 0; slot < EmptySlot; ++slot) {
+    pieces[slot].push_back(valid ? slots[slot] : 0);
+  }
+  occupied.push_back(valid ? ~slots[EmptySlot] : 0);
+  return valid;
+}
+
+void PositionBatch::clear() {
+  for (std::vector<Bitboard>& slot : pieces) {
+    slot.clear();
+  }
+  occupied.clear();
+}
+
+#if defined(__x86_64__)
+inline bool cpuHasAvx512() { return __builtin_cpu_supports("avx512f"); }
+#else
+inline bool cpuHasAvx512() { return false; }
+#endif
+
+const bool UseAvx512 = cpuHasAvx512();
+
+constexpr Bitboard FileA = 0x0101010101010101ULL;
+constexpr Bitboard FileB = FileA << 1;
+constexpr Bitboard FileG = FileA << 6;
+constexpr Bitboard FileH = FileA << 7;
+
+// The batch kernel is written once over a lane type V: Bitboard for one position, or a GCC vector of 4 or 8
+// Bitboards that the target("avx2") and target("avx512f") callers below compile to vector instructions.
+// Everything is always inlined into those callers, so the ABI note GCC gives for vector arguments never applies.
+// GCC reports it at the end of the file, hence no pop. Vector arguments go by reference for the same reason.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+using Lanes4 = Bitboard __attribute__((vector_size(32)));
+using Lanes8 = Bitboard __attribute__((vector_size(64)));
+
+// Moves every square by `Step` (a8 = 0, so negative steps go towards rank 8), dropping those that leave the
+// board on the side `keep` excludes.
+template <int Step, typename V>
+__attribute__((always_inline)) inline V shiftLanes(const V& bits, Bitboard keep) {
+  return (Step > 0 ? bits << Step : bits >> -Step) & keep;
+}
+
+// Kogge-Stone fill from `from` through the empty squares, then one step more: the squares a slider on `from`
+// reaches in one direction.
+template <int Step, typename V>
+__attribute__((always_inline)) inline V rayLanes(const V& from, const V& empty, Bitboard keep) {
+  V fill = from;
+  V open = empty & keep;
+  fill |= open & shiftLanes<Step>(fill, ~Bitboard{0});
+  open &= shiftLanes<Step>(open, ~Bitboard{0});
+  fill |= open & shiftLanes<2 * Step>(fill, ~Bitboard{0});
+  open &= shiftLanes<2 * Step>(open, ~Bitboard{0});
+  fill |= open & shiftLanes<4 * Step>(fill, ~Bitboard{0});
+  return shiftLanes<Step>(fill, keep);
+}
+
+// Pieces of color `by` attacking `king`, a single square per lane (or none), cast outward from the king.
+template <typename V>
+__attribute__((always_inline)) inline V kingAttackersLanes(const V& king, Color by, const std::array<V, 12>& pieces,
+                                                           const V& occupied) {
+  const int base = by == Color::White ? 0 : 6;
+  const V empty = ~occupied;
+  const V rookRays = rayLanes<-8>(king, empty, ~Bitboard{0}) | rayLanes<8>(king, empty, ~Bitboard{0}) |
+                     rayLanes<1>(king, empty, ~FileA) | rayLanes<-1>(king, empty, ~FileH);
+  const V bishopRays = rayLanes<-7>(king, empty, ~FileA) | rayLanes<-9>(king, empty, ~FileH) |
+                       rayLanes<9>(king, empty, ~FileA) | rayLanes<7>(king, empty, ~FileH);
+  const V knightSquares = shiftLanes<17>(king, ~FileA) | shiftLanes<15>(king, ~FileH) |
+                          shiftLanes<10>(king, ~(FileA | FileB)) | shiftLanes<6>(king, ~(FileG | FileH)) |
+                          shiftLanes<-17>(king, ~FileH) | shiftLanes<-15>(king, ~FileA) |
+                          shiftLanes<-10>(king, ~(FileG | FileH)) | shiftLanes<-6>(king, ~(FileA | FileB));
+  const V kingSquares = shiftLanes<-8>(king, ~Bitboard{0}) | shiftLanes<8>(king, ~Bitboard{0}) |
+                        shiftLanes<1>(king, ~FileA) | shiftLanes<-1>(king, ~FileH) | shiftLanes<-7>(king, ~FileA) |
+                        shiftLanes<-9>(king, ~FileH) | shiftLanes<9>(king, ~FileA) | shiftLanes<7>(king, ~FileH);
+  // Where a pawn of `by` must stand to attack the king: behind it from that pawn's point of view.
+  const V pawnSquares = by == Color::Black ? shiftLanes<-9>(king, ~FileH) | shiftLanes<-7>(king, ~FileA)
+                                           : shiftLanes<9>(king, ~FileA) | shiftLanes<7>(king, ~FileH);
+  const V queens = pieces[base + 4];
+  return (rookRays & (pieces[base + 3] | queens)) | (bishopRays & (pieces[base + 2] | queens)) |
+         (knightSquares & pieces[base + 1]) | (kingSquares & pieces[base + 5]) | (pawnSquares & pieces[base]);
+}
+
+// Check status of the positions from `first` on, sizeof(V) / 8 of them.
+template <typename V>
+__attribute__((always_inline)) inline void checkStatusLanes(const PositionBatch& batch, std::size_t first,
+                                                            std::uint8_t* results) {
+  constexpr std::size_t Width = sizeof(V) / sizeof(Bitboard);
+  std::array<V, 12> pieces;
+  for (int slot = 0; slot < 12; ++slot) {
+    std::memcpy(&pieces[slot], batch.pieces[slot].data() + first, sizeof(V));
+  }
+  V occupied;
+  std::memcpy(&occupied, batch.occupied.data() + first, sizeof(V));
+  // Like isInCheck(), only the lowest king of a color counts.
+  const V zero = occupied ^ occupied;
+  const V whiteKing = pieces[5] & (zero - pieces[5]);
+  const V blackKing = pieces[11] & (zero - pieces[11]);
+  const V white = kingAttackersLanes(whiteKing, Color::Black, pieces, occupied);
+  const V black = kingAttackersLanes(blackKing, Color::White, pieces, occupied);
+  Bitboard whiteLanes[Width];
+  Bitboard blackLanes[Width];
+  std::memcpy(whiteLanes, &white, sizeof(V));
+  std::memcpy(blackLanes, &black, sizeof(V));
+  for (std::size_t lane = 0; lane < Width; ++lane) {
+    results[first + lane] = (whiteLanes[lane] ? WhiteInCheck : 0) | (blackLanes[lane] ? BlackInCheck : 0);
+  }
+}
+
+// Returns where the vector kernels stopped; the rest is left to the scalar one.
+__attribute__((target("avx2"))) std::size_t batchCheckStatusAvx2(const PositionBatch& batch, std::uint8_t* results) {
+  std::size_t first = 0;
+  for (; first + 4 <= batch.size(); first += 4) {
+    checkStatusLanes<Lanes4>(batch, first, results);
+  }
+  return first;
+}
+
+__attribute__((target("avx512f"))) std::size_t batchCheckStatusAvx512(const PositionBatch& batch,
+                                                                      std::uint8_t* results) {
+  std::size_t first = 0;
+  for (; first + 8 <= batch.size(); first += 8) {
+    checkStatusLanes<Lanes8>(batch, first, results);
+  }
+  return first;
+}
+
+void batchCheckStatus(const PositionBatch& batch, std::uint8_t* results) {
+  std::size_t first = 0;
+#if defined(__x86_64__)
+  first = UseAvx512 ? batchCheckStatusAvx512(batch, results) : UseAvx2 ? batchCheckStatusAvx2(batch, results) : 0;
+#endif
+  for (; first < batch.size(); ++first) {
+    checkStatusLanes<Bitboard>(batch, first, results);
+  }
+}
+
+std::string moveToString(Move move) {
+  std::string text;
+  for (int square : {moveFrom(move), moveTo(move)}) {
+    text += static_cast<char>('a' + square % 8);
+    text += static_cast<char>('8' - square / 8);
+  }
+  if (movePromotion(move) != PieceKind::Pawn) {
+    text += "pnbrqk"[static_cast<int>(movePromotion(move))];
+  }
+  return text;
+}
+
+std::string moveToText(const ChessBoard& board, Move move) {
+  const char piece = board.at(moveFrom(move));
+  std::string text(1, piece);
+  for (int square : {moveFrom(move), moveTo(move)}) {
+    if (square == moveTo(move) && isCapture(move)) {
+      text += 'x';
+    }
+    text += static_cast<char>('a' + square % 8);
+    text += static_cast<char>('8' - square / 8);
+  }
+  if (movePromotion(move) != PieceKind::Pawn) {
+    text += '=';
+    text += movePromotion(move) <= PieceKind::King ? pieceChar(isupper(piece), movePromotion(move)) : '?';
+  }
+  return text;
+}
+
+// Rights that survive a move touching each square; moving a king or rook, or capturing a rook, drops them.
+constexpr std::array<std::uint8_t, 64> makeCastlingKeep() {
+  std::array<std::uint8_t, 64> keep{};
+  for (auto& rights : keep) {
+    rights = AllCastling;
+  }
+  keep[60] &= ~(WhiteKingside | WhiteQueenside);
+  keep[63] &= ~WhiteKingside;
+  keep[56] &= ~WhiteQueenside;
+  keep[4] &= ~(BlackKingside | BlackQueenside);
+  keep[7] &= ~BlackKingside;
+  keep[0] &= ~BlackQueenside;
+  return keep;
+}
+
+constexpr std::array<std::uint8_t, 64> CastlingKeep = makeCastlingKeep();
+
+MoveRecord makeMove(ChessBoard& board, Move move) {
+  const int from = moveFrom(move);
+  const int to = moveTo(move);
+  const char moved = board.at(from);
+  MoveRecord record{static_cast<std::uint8_t>(from), static_cast<std::uint8_t>(to), moved, board.at(to),
+                    board.castlingRights, static_cast<std::int8_t>(board.epSquare)};
+
+  if (record.isEnPassant()) {
+    record.captured = board.at(record.capturedSquare());
+    board.set(record.capturedSquare(), ' ');
+  }
+  const bool white = isupper(moved);
+  board.set(to, movePromotion(move) == PieceKind::Pawn ? moved : pieceChar(white, movePromotion(move)));
+  board.set(from, ' ');
+  if (record.isCastling()) {
+    board.set(castlingRook(to)[1], board.at(castlingRook(to)[0]));
+    board.set(castlingRook(to)[0], ' ');
+  }
+
+  board.setEpSquare((moved == 'P' || moved == 'p') && std::abs(to - from) == 16 ? (from + to) / 2 : -1);
+  board.setCastlingRights(board.castlingRights & CastlingKeep[from] & CastlingKeep[to]);
+  return record;
+}
+
+void unmakeMove(ChessBoard& board, const MoveRecord& record) {
+  if (record.isCastling()) {
+    board.set(castlingRook(record.to)[0], board.at(castlingRook(record.to)[1]));
+    board.set(castlingRook(record.to)[1], ' ');
+  }
+  board.set(record.from, record.moved);
+  board.set(record.to, ' ');
+  board.set(record.capturedSquare(), record.captured);
+  board.setCastlingRights(record.castlingRights);
+  board.setEpSquare(record.epSquare);
+}
+
+// Every piece of one kind, through the same reachableSquares() rules the M path validates with.
+template <PieceKind Kind, Color Side>
+void addPieceMoves(const ChessBoard& board, MoveList& list) {
+  constexpr Bitboard lastRank = Side == Color::White ? Bitboard{0xFF} : Bitboard{0xFF} << 56;
+  for (Bitboard pieces = board.piecesOf(Side, Kind); pieces;) {
+    const int from = popLowestSquare(pieces);
+    for (Bitboard targets = reachableSquares<Kind, Side>(from, board); targets;) {
+      const int to = popLowestSquare(targets);
+      const bool capture =
+          (board.colorMask(opposite(Side)) & squareBit(to)) || (Kind == PieceKind::Pawn && to == board.epSquare);
+      if (Kind == PieceKind::Pawn && (lastRank & squareBit(to))) {
+        for (PieceKind promotion : {PieceKind::Queen, PieceKind::Rook, PieceKind::Bishop, PieceKind::Knight}) {
+          list.add(encodeMove(from, to, promotion, capture));
+        }
+      } else {
+        list.add(encodeMove(from, to, PieceKind::Pawn, capture));
+      }
+    }
+  }
+}
+
+template <Color Side>
+void generatePseudoLegalMoves(const ChessBoard& board, MoveList& list) {
+  addPieceMoves<PieceKind::Pawn, Side>(board, list);
+  addPieceMoves<PieceKind::Knight, Side>(board, list);
+  addPieceMoves<PieceKind::Bishop, Side>(board, list);
+  addPieceMoves<PieceKind::Rook, Side>(board, list);
+  addPieceMoves<PieceKind::Queen, Side>(board, list);
+  addPieceMoves<PieceKind::King, Side>(board, list);
+}
+
+// Squares strictly between two squares sharing a rank, file or diagonal, and the whole line through them;
+// both are empty for squares that share none.
+struct SquarePairMasks {
+  std::array<std::array<Bitboard, 64>, 64> between{};
+  std::array<std::array<Bitboard, 64>, 64> line{};
+};
+
+constexpr SquarePairMasks makeSquarePairMasks() {
+  SquarePairMasks masks;
+  for (int from = 0; from < 64; ++from) {
+    for (const Directions& directions : {RookDirections, BishopDirections}) {
+      for (const auto& direction : directions) {
+        // The ray from `from` one way, then the other, so `line` holds the whole line once the first half is done.
+        Bitboard line = squareBit(from);
+        for (int sign : {-1, 1}) {
+          const int rankStep = sign * direction[0];
+          const int fileStep = sign * direction[1];
+          Bitboard between = 0;
+          for (int rank = from / 8 + rankStep, file = from % 8 + fileStep;
+               rank >= 0 && rank < 8 && file >= 0 && file < 8; rank += rankStep, file += fileStep) {
+            const int to = toSquare(rank, file);
+            masks.between[from][to] = between;
+            between |= squareBit(to);
+            line |= squareBit(to);
+          }
+        }
+        for (Bitboard squares = line ^ squareBit(from); squares;) {
+          masks.line[from][popLowestSquare(squares)] = line;
+        }
+      }
+    }
+  }
+  return masks;
+}
+
+const SquarePairMasks SquarePairs = makeSquarePairMasks();
+
+LegalityMasks legalityMasks(Color side, const ChessBoard& board) {
+  LegalityMasks masks;
+  const Bitboard kings = board.piecesOf(side, PieceKind::King);
+  if (!kings) {
+    return masks;
+  }
+  if (kings & (kings - 1)) {
+    masks.exact = false;
+    return masks;
+  }
+  const int king = __builtin_ctzll(kings);
+  const Color them = opposite(side);
+  masks.king = king;
+  masks.checkers = attackersTo(king, them, board);
+  if (masks.checkers & (masks.checkers - 1)) {
+    masks.checkMask = 0;
+  } else if (masks.checkers) {
+    masks.checkMask = masks.checkers | SquarePairs.between[king][__builtin_ctzll(masks.checkers)];
+  }
+
+  // Sliders that would attack the king on an empty board pin an own piece that stands alone in between.
+  const Bitboard queens = board.piecesOf(them, PieceKind::Queen);
+  Bitboard snipers = (RookAttacks(king, 0) & (board.piecesOf(them, PieceKind::Rook) | queens)) |
+                     (BishopAttacks(king, 0) & (board.piecesOf(them, PieceKind::Bishop) | queens));
+  while (snipers) {
+    const Bitboard blockers = SquarePairs.between[king][popLowestSquare(snipers)] & board.occupied;
+    if (blockers && !(blockers & (blockers - 1))) {
+      masks.pinned |= blockers & board.colorMask(side);
+    }
+  }
+  return masks;
+}
+
+bool isLegal(Move move, Color side, const ChessBoard& board, const LegalityMasks& masks) {
+  if (!masks.exact) {
+    ChessBoard played = board;
+    makeMove(played, move);
+    return !isInCheck(side, played);
+  }
+  if (masks.king < 0) {
+    return true;
+  }
+  const int from = moveFrom(move);
+  const int to = moveTo(move);
+  const Color them = opposite(side);
+  if (from == masks.king) {
+    return !attackersTo(to, them, board, board.occupied ^ squareBit(from));
+  }
+  // En passant empties two squares on one line, which no pin mask describes: test the king against the result.
+  if (to == board.epSquare && board.piecesOf(side, PieceKind::Pawn) & squareBit(from)) {
+    const Bitboard captured = squareBit(side == Color::White ? to + 8 : to - 8);
+    const Bitboard occupied = (board.occupied ^ squareBit(from) ^ captured) | squareBit(to);
+    return !(attackersTo(masks.king, them, board, occupied) & ~captured);
+  }
+  return (masks.checkMask & squareBit(to)) &&
+         (!(masks.pinned & squareBit(from)) || (SquarePairs.line[masks.king][from] & squareBit(to)));
+}
+
+void generateLegalMoves(const ChessBoard& board, Color side, MoveList& list) {
+  MoveList candidates;
+  if (side == Color::White) {
+    generatePseudoLegalMoves<Color::White>(board, candidates);
+  } else {
+    generatePseudoLegalMoves<Color::Black>(board, candidates);
+  }
+  const LegalityMasks masks = legalityMasks(side, board);
+  for (Move move : candidates) {
+    if (isLegal(move, side, board, masks)) {
+      list.add(move);
+    }
+  }
+}
+
+// Whether a piece of one kind has a legal move landing in `landing`.
+template <PieceKind Kind, Color Side>
+bool hasLegalMoveOf(const ChessBoard& board, const LegalityMasks& masks, Bitboard landing) {
+  for (Bitboard pieces = board.piecesOf(Side, Kind); pieces;) {
+    const int from = popLowestSquare(pieces);
+    for (Bitboard targets = reachableSquares<Kind, Side>(from, board) & landing; targets;) {
+      if (isLegal(encodeMove(from, popLowestSquare(targets)), Side, board, masks)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+template <Color Side>
+bool hasLegalMove(const ChessBoard& board, const LegalityMasks& masks) {
+  if (masks.king >= 0) {
+    for (Bitboard targets = KingAttacks[masks.king] & board.targetsFor(Side); targets;) {
+      if (isLegal(encodeMove(masks.king, popLowestSquare(targets)), Side, board, masks)) {
+        return true;
+      }
+    }
+    // Double check: only the king could have moved.
+    if (!masks.checkMask) {
+      return false;
+    }
+    if (masks.checkers) {
+      const int checker = __builtin_ctzll(masks.checkers);
+      for (Bitboard captors = attackersTo(checker, Side, board) & ~squareBit(masks.king); captors;) {
+        if (isLegal(encodeMove(popLowestSquare(captors), checker), Side, board, masks)) {
+          return true;
+        }
+      }
+    }
+  }
+
+  // An en passant capture can take a checking pawn without landing on the check mask. The king comes last
+  // for castling, or for every king of a side that has several.
+  const Bitboard landing = masks.checkMask | (board.epSquare >= 0 ? squareBit(board.epSquare) : 0);
+  return hasLegalMoveOf<PieceKind::Pawn, Side>(board, masks, landing) ||
+         hasLegalMoveOf<PieceKind::Knight, Side>(board, masks, landing) ||
+         hasLegalMoveOf<PieceKind::Bishop, Side>(board, masks, landing) ||
+         hasLegalMoveOf<PieceKind::Rook, Side>(board, masks, landing) ||
+         hasLegalMoveOf<PieceKind::Queen, Side>(board, masks, landing) ||
+         hasLegalMoveOf<PieceKind::King, Side>(board, masks, ~Bitboard{0});
+}
+
+bool hasLegalMove(const ChessBoard& board, Color side) {
+  const LegalityMasks masks = legalityMasks(side, board);
+  return side == Color::White ? hasLegalMove<Color::White>(board, masks) : hasLegalMove<Color::Black>(board, masks);
+}
+
+std::uint64_t perft(ChessBoard& board, Color side, int depth) {
+  if (depth <= 0) {
+    return 1;
+  }
+  MoveList moves;
+  generateLegalMoves(board, side, moves);
+  if (depth == 1) {
+    return moves.size();
+  }
+  std::uint64_t nodes = 0;
+  for (Move move : moves) {
+    const MoveRecord record = makeMove(board, move);
+    nodes += perft(board, opposite(side), depth - 1);
+    unmakeMove(board, record);
+  }
+  return nodes;
+}
+
+// (position key, depth) -> node count, shared by all perft threads without locks. A slot stores its data
+// and the key XOR the data; a slot torn by two racing writers no longer matches any key and reads as a miss.
+class PerftHash {
+ public:
+  explicit PerftHash(std::size_t megabytes) {
+    std::size_t size = 1;
+    while (size * 2 * sizeof(Slot) <= megabytes << 20) {
+      size *= 2;
+    }
+    slots = std::make_unique<Slot[]>(size);
+    mask = size - 1;
+  }
+
+  bool probe(std::uint64_t key, int depth, std::uint64_t& nodes) const {
+    key ^= depthKey(depth);
+    const Slot& slot = slots[key & mask];
+    const std::uint64_t data = slot.data.load(std::memory_order_relaxed);
+    if ((slot.check.load(std::memory_order_relaxed) ^ data) != key) {
+      return false;
+    }
+    nodes = data;
+    return true;
+  }
+
+  void store(std::uint64_t key, int depth, std::uint64_t nodes) {
+    key ^= depthKey(depth);
+    Slot& slot = slots[key & mask];
+    slot.check.store(key ^ nodes, std::memory_order_relaxed);
+    slot.data.store(nodes, std::memory_order_relaxed);
+  }
+
+ private:
+  struct Slot {
+    std::atomic<std::uint64_t> check{0};
+    std::atomic<std::uint64_t> data{0};
+  };
+
+  static std::uint64_t depthKey(int depth) { return static_cast<std::uint64_t>(depth) * 0x9E3779B97F4A7C15ULL; }
+
+  std::unique_ptr<Slot[]> slots;
+  std::size_t mask = 0;
+};
+
+std::uint64_t perft(ChessBoard& board, Color side, int depth, PerftHash& hash) {
+  if (depth <= 1) {
+    return perft(board, side, depth);
+  }
+  const std::uint64_t key = positionKey(board, side);
+  std::uint64_t nodes = 0;
+  if (hash.probe(key, depth, nodes)) {
+    return nodes;
+  }
+  MoveList moves;
+  generateLegalMoves(board, side, moves);
+  for (Move move : moves) {
+    const MoveRecord record = makeMove(board, move);
+    nodes += perft(board, opposite(side), depth - 1, hash);
+    unmakeMove(board, record);
+  }
+  hash.store(key, depth, nodes);
+  return nodes;
+}
+
+// Perft across a pool of threads. The first SplitPlies plies are expanded into tasks; each worker runs
+// tasks from the back of its own deque (pushing the children of split tasks there too) and, once that
+// is empty, steals from the front of the others', where the biggest untouched subtrees wait. A worker
+// that finds nothing to take sleeps until a task is queued or the last one finishes.
+class ParallelPerft {
+ public:
+  static constexpr int SplitPlies = 2;
+
+  ParallelPerft(int threads, PerftHash& hash)
+      : threadCount(threads), queues(std::make_unique<Queue[]>(threads)), hash(hash) {}
+
+  // Node count below each legal root move, in generation order.
+  std::vector<std::pair<Move, std::uint64_t>> run(ChessBoard& board, Color side, int depth) {
+    MoveList moves;
+    generateLegalMoves(board, side, moves);
+    std::vector<std::pair<Move, std::uint64_t>> result;
+    rootNodes = std::make_unique<std::atomic<std::uint64_t>[]>(moves.size());
+    pending = 0;
+
+    for (int root = 0; root < moves.size(); ++root) {
+      const Move move = moves.moves[root];
+      result.push_back({move, 1});
+      rootNodes[root] = 0;
+      if (depth > 1) {
+        const MoveRecord record = makeMove(board, move);
+        push(root % threadCount, PerftTask{board, opposite(side), depth - 1, 1, root});
+        unmakeMove(board, record);
+      }
+    }
+
+    std::vector<std::thread> workers;
+    for (int index = 0; index < threadCount; ++index) {
+      workers.emplace_back(&ParallelPerft::work, this, index);
+    }
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+
+    if (depth > 1) {
+      for (std::size_t root = 0; root < result.size(); ++root) {
+        result[root].second = rootNodes[root];
+      }
+    }
+    return result;
+  }
+
+ private:
+  struct PerftTask {
+    ChessBoard board;
+    Color side;
+    int depth;
+    int ply;
+    int root;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<PerftTask> tasks;
+  };
+
+  void push(int index, PerftTask&& task) {
+    pending.fetch_add(1);
+    {
+      std::lock_guard<std::mutex> lock(queues[index].mutex);
+      queues[index].tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> lock(idleMutex);
+      ++queued;
+    }
+    idle.notify_one();
+  }
+
+  bool take(int index, PerftTask& task) {
+    for (int offset = 0; offset < threadCount; ++offset) {
+      Queue& queue = queues[(index + offset) % threadCount];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      if (offset == 0) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+      std::lock_guard<std::mutex> idleLock(idleMutex);
+      --queued;
+      return true;
+    }
+    return false;
+  }
+
+  void work(int index) {
+    PerftTask task;
+    while (true) {
+      if (!take(index, task)) {
+        std::unique_lock<std::mutex> lock(idleMutex);
+        idle.wait(lock, [this] { return queued > 0 || pending.load() == 0; });
+        if (pending.load() == 0) {
+          return;
+        }
+        continue;
+      }
+      if (task.ply < SplitPlies && task.depth > 2) {
+        MoveList moves;
+        generateLegalMoves(task.board, task.side, moves);
+        for (Move move : moves) {
+          const MoveRecord record = makeMove(task.board, move);
+          push(index, PerftTask{task.board, opposite(task.side), task.depth - 1, task.ply + 1, task.root});
+          unmakeMove(task.board, record);
+        }
+      } else {
+        rootNodes[task.root].fetch_add(perft(task.board, task.side, task.depth, hash));
+      }
+      if (pending.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        idle.notify_all();
+      }
+    }
+  }
+
+  int threadCount;
+  std::unique_ptr<Queue[]> queues;
+  std::unique_ptr<std::atomic<std::uint64_t>[]> rootNodes;
+  std::atomic<int> pending{0};
+  // Tasks sitting in a queue, guarded by idleMutex; may dip below zero while a push is still counting.
+  int queued = 0;
+  std::mutex idleMutex;
+  std::condition_variable idle;
+  PerftHash& hash;
+};
+
+constexpr std::size_t PerftHashMegabytes = 128;
+
+// Below this depth a tree is too small to pay for starting the workers.
+constexpr int ParallelPerftMinDepth = 4;
+
+// One table for the whole process, allocated on the first parallel perft. Entries are exact node counts,
+// so they stay valid across calls, positions and concurrent sessions.
+PerftHash& sharedPerftHash() {
+  static PerftHash hash(PerftHashMegabytes);
+  return hash;
+}
+
+std::vector<std::pair<Move, std::uint64_t>> perftByRootMove(ChessBoard& board, Color side, int depth, int threads) {
+  // Without a ply to play there are no root moves to divide over.
+  if (depth < 1) {
+    return {};
+  }
+  if (threads > 1 && depth >= ParallelPerftMinDepth) {
+    return ParallelPerft(threads, sharedPerftHash()).run(board, side, depth);
+  }
+  MoveList moves;
+  generateLegalMoves(board, side, moves);
+  std::vector<std::pair<Move, std::uint64_t>> result;
+  for (Move move : moves) {
+    const MoveRecord record = makeMove(board, move);
+    result.push_back({move, perft(board, opposite(side), depth - 1)});
+    unmakeMove(board, record);
+  }
+  return result;
+}
+
+std::uint64_t perftDivide(ChessBoard& board, Color side, int depth, int threads, std::ostream& out) {
+  std::uint64_t total = 0;
+  for (const auto& [move, nodes] : perftByRootMove(board, side, depth, threads)) {
+    out << moveToString(move) << ": " << nodes << '\n';
+    total += nodes;
+  }
+  out << "\nNodes searched: " << total << '\n';
+  return total;
+}
+
+bool loadFen(const std::string& fen, ChessBoard& board, Color& side) {
+  std::istringstream fields(fen);
+  std::string placement, color, castling = "-", enPassant = "-";
+  if (!(fields >> placement >> color)) {
+    return false;
+  }
+  fields >> castling >> enPassant;
+
+  board = ChessBoard();
+  int square = 0;
+  for (char c : placement) {
+    if (c == '/') {
+      continue;
+    }
+    if (c >= '1' && c <= '8') {
+      square += c - '0';
+    } else if (pieceIndex(c) >= 0 && square < 64) {
+      board.set(square++, c);
+    } else {
+      return false;
+    }
+  }
+  if (square != 64 || (color != "w" && color != "b")) {
+    return false;
+  }
+  side = color == "w" ? Color::White : Color::Black;
+
+  std::uint8_t rights = 0;
+  for (char c : castling) {
+    switch (c) {
+      case 'K': rights |= WhiteKingside; break;
+      case 'Q': rights |= WhiteQueenside; break;
+      case 'k': rights |= BlackKingside; break;
+      case 'q': rights |= BlackQueenside; break;
+      default: break;
+    }
+  }
+  board.setCastlingRights(rights);
+  if (enPassant.size() == 2 && enPassant[0] >= 'a' && enPassant[0] <= 'h' && enPassant[1] >= '1' &&
+      enPassant[1] <= '8') {
+    board.setEpSquare(toSquare('8' - enPassant[1], enPassant[0] - 'a'));
+  }
+  return true;
+}
+
+bool isValidPromotionPiece(char piece) {
+  return (piece == 'Q' || piece == 'N' || piece == 'R' || piece == 'B' || piece == 'q' || piece == 'n' ||
+          piece == 'r' || piece == 'b');
+}
+
+bool isValidSquare(int rank, int file) { return (rank >= 1 && rank <= 8 && file >= 1 && file <= 8); }
+
+bool isValidPiece(char piece, Color side) {
+  return side == Color::White
+             ? (piece == 'P' || piece == 'K' || piece == 'N' || piece == 'R' || piece == 'Q' || piece == 'B')
+             : (piece == 'p' || piece == 'k' || piece == 'n' || piece == 'r' || piece == 'q' || piece == 'b');
+}
+
+void convertInput(std::string_view input, Color side, int& fromRank, int& fromFile, int& toRank, int& toFile) {
+  if (input.size() < 5 || (input[3] == 'x' && input.size() < 6)) {
+    fromRank = fromFile = toRank = toFile = -1;
+    return;
+  }
+
+  fromFile = input[1] - 'a';
+  fromRank = 8 - (input[2] - '0');
+
+  char piece = input[0];
+
+  if (!isValidPiece(piece, side)) {
+    fromRank = fromFile = toRank = toFile = -1;
+    return;
+  }
+
+  if (input[3] == 'x') {
+    toFile = input[4] - 'a';
+    toRank = 8 - (input[5] - '0');
+  } else {
+    toFile = input[3] - 'a';
+    toRank = 8 - (input[4] - '0');
+  }
+
+  int rankDiff = std::abs(toRank - fromRank);
+  int fileDiff = std::abs(toFile - fromFile);
+
+  if ((piece == 'B' || piece == 'b') && rankDiff != fileDiff) {
+    fromRank = fromFile = toRank = toFile = -1;
+  }
+}
+
+bool King::isValidMove(int toRank, int toFile, const ChessBoard& board) const {
+  return isValidMoveAs<PieceKind::King>(toRank, toFile, board);
+}
+
+bool Pawn::isValidMove(int toRank, int toFile, const ChessBoard& board) const {
+  return isValidMoveAs<PieceKind::Pawn>(toRank, toFile, board);
+}
+
+/*bool Pawn::isPawnCaptureMove(int toRank, int toFile, const ChessBoard& board) const {
+  if (!isValidSquare(toRank, toFile)) {
+    return false;
+  }
+
+  char targetPiece = board[toRank][toFile];
+
+  if (targetPiece != ' ' && isOpponentPiece(targetPiece)) {
+    int rankDiff = abs(toRank - getRank());
+    int fileDiff = abs(toFile - getFile());
+
+    if (rankDiff == 1 && fileDiff == 1) {
+      return true;
+    }
+  }
+
+  return false;
+}*/
+
+bool Rook::isValidMove(int toRank, int toFile, const ChessBoard& board) const {
+  return isValidMoveAs<PieceKind::Rook>(toRank, toFile, board);
+}
+
+bool Rook::isPathClear(int toRank, int toFile, const ChessBoard& board) const {
+  return RookAttacks(getSquare(), board.occupied) & squareBit(toSquare(toRank, toFile));
+}
+
+bool Bishop::isValidMove(int toRank, int toFile, const ChessBoard& board) const {
+  return isValidMoveAs<PieceKind::Bishop>(toRank, toFile, board);
+}
+
+bool Knight::isValidMove(int toRank, int toFile, const ChessBoard& board) const {
+  return isValidMoveAs<PieceKind::Knight>(toRank, toFile, board);
+}
+
+bool Queen::isValidMove(int toRank, int toFile, const ChessBoard& board) const {
+  return isValidMoveAs<PieceKind::Queen>(toRank, toFile, board);
+}
+
+bool isValidMove(const ChessPiece& piece, int toRank, int toFile, const ChessBoard& board) {
+  return piece.isValidMove(toRank, toFile, board);
+}
+
+bool InCheck(const ChessPiece& king, const ChessBoard& board) {
+  countInCheck();
+  return attackersTo(king.getSquare(), opposite(king.getColor()), board);
+}
+
+Verdict Position::loadBoard(std::string_view squares) {
+  {
+    const StageTimer timer(Stage::Parse);
+    if (!hasBoardLength(squares) || !board.loadSquares(squares.data())) {
+      return Verdict::Invalid;
+    }
+  }
+  board.setCastlingRights(0);
+  board.setEpSquare(-1);
+  side = Color::White;
+  undoLog.clear();
+  attackMapStale = true;
+  return verdict();
+}
+
+bool Position::loadFen(const std::string& fen) {
+  ChessBoard loaded;
+  Color loadedSide;
+  if (!::loadFen(fen, loaded, loadedSide)) {
+    return false;
+  }
+  board = loaded;
+  side = loadedSide;
+  undoLog.clear();
+  attackMapStale = true;
+  return true;
+}
+
+bool Position::parseMove(std::string_view text, Move& move) const {
+  const StageTimer timer(Stage::Parse);
+  if (text.size() < 5) {
+    return false;
+  }
+  int fromRank, fromFile, toRank, toFile;
+  convertInput(text, side, fromRank, fromFile, toRank, toFile);
+
+  const char piece = text[0];
+  if (!isValidSquare(fromRank + 1, fromFile + 1) || !isValidSquare(toRank + 1, toFile + 1) ||
+      board[fromRank][fromFile] != piece) {
+    return false;
+  }
+
+  const std::size_t promotionAt = text.find('=');
+  const char promotionPiece =
+      promotionAt != std::string_view::npos && promotionAt + 1 < text.size() ? text[promotionAt + 1] : ' ';
+  const bool reachesLastRank = (piece == 'P' && toRank == 0) || (piece == 'p' && toRank == 7);
+  const bool promotes = isValidPromotionPiece(promotionPiece) && isValidPiece(promotionPiece, side);
+  if (reachesLastRank ? !promotes : promotionAt != std::string_view::npos) {
+    return false;
+  }
+
+  const PieceKind promotion =
+      reachesLastRank ? static_cast<PieceKind>(pieceIndex(promotionPiece) % 6) : PieceKind::Pawn;
+  move = encodeMove(toSquare(fromRank, fromFile), toSquare(toRank, toFile), promotion, text[3] == 'x');
+  return true;
+}
+
+Verdict Position::playMove(std::string_view text) {
+  Move move;
+  return parseMove(text, move) ? playMove(move) : Verdict::Invalid;
+}
+
+bool Position::isPlayable(Move move) const {
+  const StageTimer timer(Stage::Validate);
+  const int from = moveFrom(move);
+  const int to = moveTo(move);
+  const char piece = board.at(from);
+  const bool pawn = piece == 'P' || piece == 'p';
+  const bool reachesLastRank = pawn && (to < 8 || to >= 56);
+  const bool promotes = movePromotion(move) >= PieceKind::Knight && movePromotion(move) <= PieceKind::Queen;
+  const bool enPassant = pawn && to == board.epSquare;
+  return isValidPiece(piece, side) && isValidMove(piece, from, to, board) &&
+         isCapture(move) == (board.at(to) != ' ' || enPassant) &&
+         (reachesLastRank ? promotes : movePromotion(move) == PieceKind::Pawn) &&
+         isLegal(move, side, board, legalityMasks(side, board));
+}
+
+Verdict Position::playMove(Move move) {
+  if (!isPlayable(move)) {
+    return Verdict::Invalid;
+  }
+
+  const MoveRecord record = makeMove(board, move);
+  undoLog.push(record);
+
+  if (!attackMapStale) {
+    attackMap.update(board, record.squares());
+  }
+  side = opposite(side);
+  return verdict();
+}
+
+Verdict Position::takeBack(std::size_t plies) {
+  if (plies == 0 || plies > undoLog.size()) {
+    return Verdict::Invalid;
+  }
+  Bitboard changed = 0;
+  for (std::size_t ply = 0; ply < plies; ++ply) {
+    const MoveRecord record = undoLog.pop();
+    unmakeMove(board, record);
+    changed |= record.squares();
+    side = isupper(record.moved) ? Color::White : Color::Black;
+  }
+  if (!attackMapStale) {
+    attackMap.update(board, changed);
+  }
+  return verdict();
+}
+
+bool Position::inCheck() {
+  const StageTimer timer(Stage::Check);
+  countInCheck();
+  const std::uint64_t key = positionKey(board, side);
+  bool inCheck = false;
+  if (verdictCache && verdictCache->probe(key, inCheck)) {
+    return inCheck;
+  }
+  if (attackMapStale) {
+    attackMap.rebuild(board);
+    attackMapStale = false;
+  }
+  inCheck = attackMap.isInCheck(side, board);
+  if (verdictCache) {
+    verdictCache->store(key, inCheck);
+  }
+  return inCheck;
+}
+
+GameStatus Position::status() {
+  const bool check = inCheck();
+  if (hasLegalMove(board, side)) {
+    return check ? GameStatus::Check : GameStatus::Normal;
+  }
+  return check ? GameStatus::Checkmate : GameStatus::Stalemate;
+}
+
+AttackSets Position::attackSets() {
+  if (attackMapStale) {
+    attackMap.rebuild(board);
+    attackMapStale = false;
+  }
+  AttackSets sets;
+  for (Color color : {Color::White, Color::Black}) {
+    for (Bitboard pieces = board.colorMask(color); pieces;) {
+      sets.attacked[static_cast<int>(color)] |= attackMap.attacksOf(popLowestSquare(pieces));
+    }
+  }
+  for (int square = 0; square < 64; ++square) {
+    sets.attackers[square] = attackMap.attackersOf(square);
+  }
+  return sets;
+}
+
+std::uint64_t Position::perft(int depth, int threads) {
+  if (depth < 1) {
+    return 1;
+  }
+  std::uint64_t total = 0;
+  for (const auto& divide : perftByRootMove(board, side, depth, threads)) {
+    total += divide.second;
+  }
+  return total;
+}
+
+std::uint64_t Position::perftDivide(int depth, int threads, std::ostream& out) {
+  return ::perftDivide(board, side, depth, threads, out);
+}
+
+void Position::print(std::string& out) const {
+  for (const ChessBoard::Rank& rank : board.squares) {
+    out.append(rank.data(), rank.size());
+    out += '\n';
+  }
+}
@@ -0,0 +1,850 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "stats.h"
+
+using Bitboard = std::uint64_t;
+
+enum class Color : std::uint8_t { White, Black };
+enum class PieceKind : std::uint8_t { Pawn, Knight, Bishop, Rook, Queen, King };
+
+// Squares are numbered like the B line: a8 = 0, h8 = 7, ..., h1 = 63.
+constexpr int toSquare(int rank, int file) { return rank * 8 + file; }
+constexpr Bitboard squareBit(int square) { return Bitboard{1} << square; }
+constexpr Color opposite(Color color) { return color == Color::White ? Color::Black : Color::White; }
+
+inline int popLowestSquare(Bitboard& bits) {
+  int square = __builtin_ctzll(bits);
+  bits &= bits - 1;
+  return square;
+}
+
+constexpr char pieceChar(bool white, PieceKind kind) { return (white ? "PNBRQK" : "pnbrqk")[static_cast<int>(kind)]; }
+
+// Index into ChessBoard::pieces (color * 6 + kind), -1 for anything that is not a piece.
+constexpr int pieceIndex(char piece) {
+  switch (piece) {
+    case 'P': return 0;
+    case 'N': return 1;
+    case 'B': return 2;
+    case 'R': return 3;
+    case 'Q': return 4;
+    case 'K': return 5;
+    case 'p': return 6;
+    case 'n': return 7;
+    case 'b': return 8;
+    case 'r': return 9;
+    case 'q': return 10;
+    case 'k': return 11;
+    default: return -1;
+  }
+}
+
+constexpr int EmptySlot = 12;
+constexpr int BlockerSlot = 13;
+
+// Where a board char is tallied in ChessBoard::pieces: its pieceIndex(), EmptySlot for ' ', BlockerSlot otherwise.
+constexpr std::array<std::uint8_t, 256> makeBoardSlots() {
+  std::array<std::uint8_t, 256> slots{};
+  for (int c = 0; c < 256; ++c) {
+    const int index = pieceIndex(static_cast<char>(c));
+    slots[c] = index >= 0 ? index : c == ' ' ? EmptySlot : BlockerSlot;
+  }
+  return slots;
+}
+
+constexpr std::array<std::uint8_t, 256> BoardSlots = makeBoardSlots();
+
+inline int boardSlot(char c) { return BoardSlots[static_cast<unsigned char>(c)]; }
+
+template <std::size_t N>
+constexpr std::array<Bitboard, 64> makeLeaperAttacks(const std::array<std::array<int, 2>, N>& steps) {
+  std::array<Bitboard, 64> attacks{};
+  for (int square = 0; square < 64; ++square) {
+    for (const auto& step : steps) {
+      int rank = square / 8 + step[0];
+      int file = square % 8 + step[1];
+      if (rank >= 0 && rank < 8 && file >= 0 && file < 8) {
+        attacks[square] |= squareBit(toSquare(rank, file));
+      }
+    }
+  }
+  return attacks;
+}
+
+constexpr std::array<Bitboard, 64> KingAttacks =
+    makeLeaperAttacks<8>({{{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1}}});
+constexpr std::array<Bitboard, 64> KnightAttacks =
+    makeLeaperAttacks<8>({{{-2, -1}, {-2, 1}, {-1, -2}, {-1, 2}, {1, -2}, {1, 2}, {2, -1}, {2, 1}}});
+// Squares a pawn of the given color on a square attacks (white moves towards rank index 0).
+constexpr std::array<std::array<Bitboard, 64>, 2> PawnAttacks = {
+    makeLeaperAttacks<2>({{{-1, -1}, {-1, 1}}}),
+    makeLeaperAttacks<2>({{{1, -1}, {1, 1}}}),
+};
+
+constexpr std::uint8_t WhiteKingside = 1;
+constexpr std::uint8_t WhiteQueenside = 2;
+constexpr std::uint8_t BlackKingside = 4;
+constexpr std::uint8_t BlackQueenside = 8;
+constexpr std::uint8_t AllCastling = 15;
+
+constexpr Bitboard Rank4 = Bitboard{0xFF} << 32;
+constexpr Bitboard Rank5 = Bitboard{0xFF} << 24;
+
+using Directions = std::array<std::array<int, 2>, 4>;
+
+constexpr Directions RookDirections = {{{-1, 0}, {1, 0}, {0, -1}, {0, 1}}};
+constexpr Directions BishopDirections = {{{-1, -1}, {-1, 1}, {1, -1}, {1, 1}}};
+
+constexpr std::uint64_t splitMix64(std::uint64_t& state) {
+  std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// Random keys for hashing positions; a position's key is the XOR of the keys of everything in it.
+struct ZobristKeys {
+  // Indexed by boardSlot(): the twelve pieces, then empty (all zero), then any other char, which still blocks rays.
+  std::array<std::array<std::uint64_t, 64>, 14> squares{};
+  std::array<std::uint64_t, 16> castling{};
+  std::array<std::uint64_t, 8> enPassantFile{};
+  std::uint64_t blackToMove = 0;
+};
+
+constexpr ZobristKeys makeZobristKeys() {
+  ZobristKeys keys;
+  std::uint64_t state = 0x5EED5EED5EED5EEDULL;
+  for (int slot = 0; slot < 14; ++slot) {
+    for (auto& key : keys.squares[slot]) {
+      key = slot == EmptySlot ? 0 : splitMix64(state);
+    }
+  }
+  // No rights hash to zero, so an empty board has key 0.
+  for (std::size_t rights = 1; rights < keys.castling.size(); ++rights) {
+    keys.castling[rights] = splitMix64(state);
+  }
+  for (auto& key : keys.enPassantFile) {
+    key = splitMix64(state);
+  }
+  keys.blackToMove = splitMix64(state);
+  return keys;
+}
+
+constexpr ZobristKeys Zobrist = makeZobristKeys();
+
+#if defined(__x86_64__)
+__attribute__((target("bmi2"))) inline std::size_t pextIndex(Bitboard occupied, Bitboard mask) {
+  return _pext_u64(occupied, mask);
+}
+inline bool cpuHasPext() { return __builtin_cpu_supports("bmi2"); }
+#else
+inline std::size_t pextIndex(Bitboard, Bitboard) { return 0; }
+inline bool cpuHasPext() { return false; }
+#endif
+
+// Picked once at startup; both index schemes fill their tables with the same attack sets.
+extern const bool UsePext;
+
+// Attack sets of one slider type for every square and every blocker configuration,
+// so "which squares does this slider reach" is a single load.
+class SlidingAttacks {
+ public:
+  SlidingAttacks(const Directions& directions, const std::array<Bitboard, 64>& magics);
+
+  Bitboard operator()(int square, Bitboard occupied) const {
+    const Entry& entry = entries[square];
+    return entry.attacks[index(entry, occupied)];
+  }
+
+ private:
+  struct Entry {
+    Bitboard mask;
+    Bitboard magic;
+    unsigned shift;
+    Bitboard* attacks;
+  };
+
+  static std::size_t index(const Entry& entry, Bitboard occupied) {
+    if (UsePext) {
+      return pextIndex(occupied, entry.mask);
+    }
+    return ((occupied & entry.mask) * entry.magic) >> entry.shift;
+  }
+
+  std::array<Entry, 64> entries{};
+  std::vector<Bitboard> table;
+};
+
+extern const SlidingAttacks RookAttacks;
+extern const SlidingAttacks BishopAttacks;
+
+inline Bitboard queenAttacks(int square, Bitboard occupied) {
+  return RookAttacks(square, occupied) | BishopAttacks(square, occupied);
+}
+
+// The char grid stays the source for print; the mailbox gives the boardSlot() of every square in one load and
+// the masks mirror both so that move and check tests are a handful of ANDs instead of square-by-square scans.
+// The per-slot masks double as piece lists: popLowestSquare() over colorMask() visits one side's pieces.
+struct ChessBoard {
+  using Rank = std::array<char, 8>;
+  using Ranks = std::array<Rank, 8>;
+
+  ChessBoard() {
+    for (auto& rank : squares) {
+      rank.fill(' ');
+    }
+    mailbox.fill(EmptySlot);
+    pieces[EmptySlot] = ~Bitboard{0};
+  }
+
+  ChessBoard(const Ranks& ranks) : ChessBoard() {
+    for (int rank = 0; rank < 8; ++rank) {
+      for (int file = 0; file < 8; ++file) {
+        set(rank, file, ranks[rank][file]);
+      }
+    }
+  }
+
+  const Rank& operator[](int rank) const { return squares[rank]; }
+  char at(int square) const { return squares[square / 8][square % 8]; }
+  // pieceIndex() of the piece on the square, EmptySlot or BlockerSlot.
+  int slotAt(int square) const { return mailbox[square]; }
+
+  void set(int square, char piece) { set(square / 8, square % 8, piece); }
+
+  // Branch-free: the old char's slot loses the square, the new one's gains it.
+  void set(int rank, int file, char piece) {
+    const int square = toSquare(rank, file);
+    const Bitboard bit = squareBit(square);
+    const int oldSlot = mailbox[square];
+    const int newSlot = boardSlot(piece);
+    pieces[oldSlot] ^= bit;
+    pieces[newSlot] ^= bit;
+    colors[oldSlot / 6] ^= bit;
+    colors[newSlot / 6] ^= bit;
+    key ^= Zobrist.squares[oldSlot][square] ^ Zobrist.squares[newSlot][square];
+    occupied = ~pieces[EmptySlot];
+    squares[rank][file] = piece;
+    mailbox[square] = static_cast<std::uint8_t>(newSlot);
+  }
+
+  void setCastlingRights(std::uint8_t rights) {
+    key ^= Zobrist.castling[castlingRights] ^ Zobrist.castling[rights];
+    castlingRights = rights;
+  }
+
+  void setEpSquare(int square) {
+    if (epSquare >= 0) {
+      key ^= Zobrist.enPassantFile[epSquare % 8];
+    }
+    if (square >= 0) {
+      key ^= Zobrist.enPassantFile[square % 8];
+    }
+    epSquare = square;
+  }
+
+  // Replaces all 64 squares at once with those of a B line, a8 first. Returns false, leaving the board
+  // as it was, if any of the 64 chars is neither a piece letter nor a space.
+  bool loadSquares(const char* text);
+
+  Bitboard piecesOf(Color color, PieceKind kind) const {
+    return pieces[static_cast<int>(color) * 6 + static_cast<int>(kind)];
+  }
+  Bitboard kindMask(PieceKind kind) const {
+    return pieces[static_cast<int>(kind)] | pieces[6 + static_cast<int>(kind)];
+  }
+  Bitboard colorMask(Color color) const { return colors[static_cast<int>(color)]; }
+  // Squares a piece of the given color may land on: empty or holding an opponent piece.
+  Bitboard targetsFor(Color color) const { return ~occupied | colorMask(opposite(color)); }
+
+  Ranks squares;
+  std::array<std::uint8_t, 64> mailbox;
+  // Per boardSlot(); colors[2] collects the empty and non-piece squares and is never read.
+  std::array<Bitboard, 14> pieces{};
+  std::array<Bitboard, 3> colors{};
+  Bitboard occupied = 0;
+  std::uint8_t castlingRights = 0;
+  int epSquare = -1;
+  // Zobrist key of everything above, kept up to date by every write.
+  std::uint64_t key = 0;
+};
+
+// Pieces of color `by` attacking `square`, found by casting every piece's attack pattern outward from the square.
+// Sliders see through to `occupied`, which lets a caller ask about a board with a few squares moved.
+inline Bitboard attackersTo(int square, Color by, const ChessBoard& board, Bitboard occupied) {
+  const Bitboard queens = board.piecesOf(by, PieceKind::Queen);
+  return (KnightAttacks[square] & board.piecesOf(by, PieceKind::Knight)) |
+         (KingAttacks[square] & board.piecesOf(by, PieceKind::King)) |
+         (PawnAttacks[static_cast<int>(opposite(by))][square] & board.piecesOf(by, PieceKind::Pawn)) |
+         (RookAttacks(square, occupied) & (board.piecesOf(by, PieceKind::Rook) | queens)) |
+         (BishopAttacks(square, occupied) & (board.piecesOf(by, PieceKind::Bishop) | queens));
+}
+
+inline Bitboard attackersTo(int square, Color by, const ChessBoard& board) {
+  return attackersTo(square, by, board, board.occupied);
+}
+
+// -1 when the board has no king of that color.
+inline int kingSquare(Color color, const ChessBoard& board) {
+  const Bitboard king = board.piecesOf(color, PieceKind::King);
+  return king ? __builtin_ctzll(king) : -1;
+}
+
+inline bool isInCheck(Color color, const ChessBoard& board) {
+  const int square = kingSquare(color, board);
+  return square >= 0 && attackersTo(square, opposite(color), board);
+}
+
+// Many positions laid out field by field, one lane per position, so that a kernel loads the same field of
+// several positions with one vector load. Only what a check test needs is kept.
+struct PositionBatch {
+  // Per pieceIndex().
+  std::array<std::vector<Bitboard>, 12> pieces;
+  std::vector<Bitboard> occupied;
+
+  void add(const ChessBoard& board);
+  // The 64 squares of a B line. A malformed board is added as an empty one and returns false.
+  bool add(const char* squares);
+  std::size_t size() const { return occupied.size(); }
+  void clear();
+};
+
+constexpr std::uint8_t WhiteInCheck = 1;
+constexpr std::uint8_t BlackInCheck = 2;
+
+// Sets results[i] to the WhiteInCheck and BlackInCheck bits of position i, the same verdicts isInCheck() gives.
+// Runs AVX-512 (8 positions a step) or AVX2 (4) kernels when the CPU has them, else one position at a time.
+void batchCheckStatus(const PositionBatch& batch, std::uint8_t* results);
+
+// Castling moves the king two squares; the rook jumps over it. The king may not start on or cross an
+// attacked square (landing on one is left to the ordinary own-king-in-check test).
+template <Color Side>
+Bitboard castlingTargets(int from, const ChessBoard& board) {
+  constexpr int home = Side == Color::White ? 60 : 4;
+  constexpr std::uint8_t kingside = Side == Color::White ? WhiteKingside : BlackKingside;
+  constexpr std::uint8_t queenside = Side == Color::White ? WhiteQueenside : BlackQueenside;
+  if (from != home || !(board.castlingRights & (kingside | queenside)) || attackersTo(home, opposite(Side), board)) {
+    return 0;
+  }
+
+  Bitboard targets = 0;
+  if ((board.castlingRights & kingside) && !(board.occupied & (squareBit(home + 1) | squareBit(home + 2))) &&
+      !attackersTo(home + 1, opposite(Side), board)) {
+    targets |= squareBit(home + 2);
+  }
+  if ((board.castlingRights & queenside) &&
+      !(board.occupied & (squareBit(home - 1) | squareBit(home - 2) | squareBit(home - 3))) &&
+      !attackersTo(home - 1, opposite(Side), board)) {
+    targets |= squareBit(home - 2);
+  }
+  return targets;
+}
+
+// Squares a piece of the given kind and color on `from` can move to, ignoring whether its own king is left in check.
+template <PieceKind Kind, Color Side>
+Bitboard reachableSquares(int from, const ChessBoard& board) {
+  if constexpr (Kind == PieceKind::Pawn) {
+    const Bitboard origin = squareBit(from);
+    const Bitboard single = (Side == Color::White ? origin >> 8 : origin << 8) & ~board.occupied;
+    const Bitboard twice = (Side == Color::White ? (single >> 8) & Rank4 : (single << 8) & Rank5) & ~board.occupied;
+    const Bitboard victims = board.colorMask(opposite(Side)) | (board.epSquare >= 0 ? squareBit(board.epSquare) : 0);
+    return (PawnAttacks[static_cast<int>(Side)][from] & victims) | single | twice;
+  } else if constexpr (Kind == PieceKind::Knight) {
+    return KnightAttacks[from] & board.targetsFor(Side);
+  } else if constexpr (Kind == PieceKind::Bishop) {
+    return BishopAttacks(from, board.occupied) & board.targetsFor(Side);
+  } else if constexpr (Kind == PieceKind::Rook) {
+    return RookAttacks(from, board.occupied) & board.targetsFor(Side);
+  } else if constexpr (Kind == PieceKind::Queen) {
+    return queenAttacks(from, board.occupied) & board.targetsFor(Side);
+  } else {
+    return (KingAttacks[from] & board.targetsFor(Side)) | castlingTargets<Side>(from, board);
+  }
+}
+
+template <PieceKind Kind, Color Side>
+bool isValidMove(int from, int to, const ChessBoard& board) {
+  return reachableSquares<Kind, Side>(from, board) & squareBit(to);
+}
+
+using MoveValidator = bool (*)(int from, int to, const ChessBoard& board);
+
+// One instantiation per board char, so validating a move is a table load and a direct call.
+constexpr std::array<MoveValidator, 256> makeMoveValidators() {
+  std::array<MoveValidator, 256> validators{};
+  validators['P'] = &isValidMove<PieceKind::Pawn, Color::White>;
+  validators['N'] = &isValidMove<PieceKind::Knight, Color::White>;
+  validators['B'] = &isValidMove<PieceKind::Bishop, Color::White>;
+  validators['R'] = &isValidMove<PieceKind::Rook, Color::White>;
+  validators['Q'] = &isValidMove<PieceKind::Queen, Color::White>;
+  validators['K'] = &isValidMove<PieceKind::King, Color::White>;
+  validators['p'] = &isValidMove<PieceKind::Pawn, Color::Black>;
+  validators['n'] = &isValidMove<PieceKind::Knight, Color::Black>;
+  validators['b'] = &isValidMove<PieceKind::Bishop, Color::Black>;
+  validators['r'] = &isValidMove<PieceKind::Rook, Color::Black>;
+  validators['q'] = &isValidMove<PieceKind::Queen, Color::Black>;
+  validators['k'] = &isValidMove<PieceKind::King, Color::Black>;
+  return validators;
+}
+
+constexpr std::array<MoveValidator, 256> MoveValidators = makeMoveValidators();
+
+inline bool isValidMove(char piece, int from, int to, const ChessBoard& board) {
+  const MoveValidator validator = MoveValidators[static_cast<unsigned char>(piece)];
+  return validator && validator(from, to, board);
+}
+
+// from | to << 6 | promotion PieceKind << 12 (Pawn when none) | capture << 15.
+using Move = std::uint16_t;
+
+constexpr Move encodeMove(int from, int to, PieceKind promotion = PieceKind::Pawn, bool capture = false) {
+  return static_cast<Move>(from | to << 6 | static_cast<int>(promotion) << 12 | (capture ? 1 << 15 : 0));
+}
+constexpr int moveFrom(Move move) { return move & 63; }
+constexpr int moveTo(Move move) { return (move >> 6) & 63; }
+constexpr PieceKind movePromotion(Move move) { return static_cast<PieceKind>((move >> 12) & 7); }
+constexpr bool isCapture(Move move) { return move >> 15; }
+
+std::string moveToString(Move move);
+// The M line body for a move on `board`: the piece on its from square, the squares and the promotion suffix.
+std::string moveToText(const ChessBoard& board, Move move);
+
+// Where the rook starts and ends when the king castles to `kingTo`.
+constexpr std::array<int, 2> castlingRook(int kingTo) {
+  switch (kingTo) {
+    case 62: return {63, 61};
+    case 58: return {56, 59};
+    case 6: return {7, 5};
+    default: return {0, 3};
+  }
+}
+
+// One ply of history: enough to put the board back without keeping a copy of it. The mover's
+// color is the case of `moved`, and a promotion is a `moved` pawn that did not land as a pawn.
+// A pawn landing on the recorded en passant square captured en passant; a king moving two files castled.
+struct MoveRecord {
+  std::uint8_t from;
+  std::uint8_t to;
+  char moved;
+  char captured;
+  std::uint8_t castlingRights;
+  std::int8_t epSquare;
+
+  bool isEnPassant() const { return to == epSquare && (moved == 'P' || moved == 'p'); }
+  bool isCastling() const { return (moved == 'K' || moved == 'k') && std::abs(to - from) == 2; }
+  int capturedSquare() const { return isEnPassant() ? (moved == 'P' ? to + 8 : to - 8) : to; }
+
+  Bitboard squares() const {
+    Bitboard squares = squareBit(from) | squareBit(to) | squareBit(capturedSquare());
+    if (isCastling()) {
+      squares |= squareBit(castlingRook(to)[0]) | squareBit(castlingRook(to)[1]);
+    }
+    return squares;
+  }
+};
+
+MoveRecord makeMove(ChessBoard& board, Move move);
+void unmakeMove(ChessBoard& board, const MoveRecord& record);
+
+// The most recent plies in a fixed ring; once it is full the oldest entries are overwritten,
+// so memory stays constant however long the input runs.
+class UndoLog {
+ public:
+  static constexpr std::size_t Capacity = 4096;
+
+  void push(const MoveRecord& record) {
+    records[top] = record;
+    top = (top + 1) % Capacity;
+    if (count < Capacity) {
+      ++count;
+    }
+  }
+
+  MoveRecord pop() {
+    top = (top + Capacity - 1) % Capacity;
+    --count;
+    return records[top];
+  }
+
+  std::size_t size() const { return count; }
+  void clear() { count = 0; }
+
+ private:
+  std::array<MoveRecord, Capacity> records;
+  std::size_t top = 0;
+  std::size_t count = 0;
+};
+
+// Sized for any board a B line can describe, not just reachable ones: no piece reaches more than the 27
+// squares of a centre queen (a pawn at most 3 x 4 promotions, a king 8 plus castling), and at most 64
+// pieces move.
+struct MoveList {
+  static constexpr int Capacity = 64 * 27;
+
+  void add(Move move) { moves[count++] = move; }
+  const Move* begin() const { return moves.data(); }
+  const Move* end() const { return moves.data() + count; }
+  int size() const { return count; }
+
+  std::array<Move, Capacity> moves;
+  int count = 0;
+};
+
+// What deciding legality needs from one position, computed once for the side to move: the pieces giving
+// check, the pinned pieces and the squares a move other than the king's must land on (anywhere when not in
+// check, the checker or a square between it and the king in single check, nowhere in double check).
+struct LegalityMasks {
+  int king = -1;
+  Bitboard checkers = 0;
+  Bitboard checkMask = ~Bitboard{0};
+  Bitboard pinned = 0;
+  // False when the side has more than one king; its moves are then tested by playing them on a copy.
+  bool exact = true;
+};
+
+LegalityMasks legalityMasks(Color side, const ChessBoard& board);
+
+// Whether a pseudo-legal move of `side` keeps its king out of check. No board is written unless `masks` is inexact.
+bool isLegal(Move move, Color side, const ChessBoard& board, const LegalityMasks& masks);
+
+// Pseudo-legal moves that do not leave the mover's own king attacked.
+void generateLegalMoves(const ChessBoard& board, Color side, MoveList& list);
+
+// Whether `side` has any legal move. Stops at the first one found, trying king moves and captures of a
+// lone checker before anything else.
+bool hasLegalMove(const ChessBoard& board, Color side);
+
+std::uint64_t perft(ChessBoard& board, Color side, int depth);
+
+inline std::uint64_t positionKey(const ChessBoard& board, Color side) {
+  return board.key ^ (side == Color::Black ? Zobrist.blackToMove : 0);
+}
+
+// Node count below each legal root move (none for a depth below 1); with more than one thread the tree is
+// split over a work-stealing pool.
+std::vector<std::pair<Move, std::uint64_t>> perftByRootMove(ChessBoard& board, Color side, int depth, int threads);
+
+// Perft with one "<move>: <nodes>" line per root move, then the total.
+std::uint64_t perftDivide(ChessBoard& board, Color side, int depth, int threads, std::ostream& out);
+
+// Reads the board, side to move, castling and en passant fields of a FEN string.
+bool loadFen(const std::string& fen, ChessBoard& board, Color& side);
+
+// A B line body: 64 piece letters or spaces, a8 first, then nothing but whitespace.
+bool isValidBoardString(std::string_view squares);
+
+bool isValidPromotionPiece(char piece);
+
+bool isValidSquare(int rank, int file);
+
+bool isValidPiece(char piece, Color side);
+
+inline bool isSameColor(char piece1, char piece2) {
+  return (piece1 >= 'a' && piece1 <= 'z' && piece2 >= 'a' && piece2 <= 'z') ||
+         (piece1 >= 'A' && piece1 <= 'Z' && piece2 >= 'A' && piece2 <= 'Z');
+}
+
+void convertInput(std::string_view input, Color side, int& fromRank, int& fromFile, int& toRank, int& toFile);
+
+class ChessPiece {
+ public:
+  ChessPiece(bool isWhite, int initialRank, int initialFile)
+      : isWhite(isWhite), currentRank(initialRank), currentFile(initialFile) {}
+
+  virtual bool isValidMove(int toRank, int toFile, const ChessBoard& board) const = 0;
+
+  bool isOpponentPiece(char piece) const { return (isWhite && islower(piece)) || (!isWhite && isupper(piece)); }
+
+  int getRank() const { return currentRank; }
+  int getFile() const { return currentFile; }
+  int getPieceType() const { return currentRank + currentFile; }
+  int getSquare() const { return toSquare(currentRank, currentFile); }
+  Color getColor() const { return isWhite ? Color::White : Color::Black; }
+
+  bool isWhite;
+  int currentRank;
+  int currentFile;
+
+ protected:
+  template <PieceKind Kind>
+  bool isValidMoveAs(int toRank, int toFile, const ChessBoard& board) const {
+    if (toRank < 0 || toRank >= 8 || toFile < 0 || toFile >= 8) {
+      return false;
+    }
+    const int to = toSquare(toRank, toFile);
+    return isWhite ? ::isValidMove<Kind, Color::White>(getSquare(), to, board)
+                   : ::isValidMove<Kind, Color::Black>(getSquare(), to, board);
+  }
+};
+
+class King : public ChessPiece {
+ public:
+  King(bool isWhite, int initialRank, int initialFile) : ChessPiece(isWhite, initialRank, initialFile) {}
+
+  bool isValidMove(int toRank, int toFile, const ChessBoard& board) const override;
+};
+
+class Pawn : public ChessPiece {
+ public:
+  char promotionPieceType = ' ';
+  char getPromotionPieceType() const { return promotionPieceType; }
+  void setPromotionPieceType(char promotionPiece) { promotionPieceType = promotionPiece; }
+  Pawn(bool isWhite, int initialRank, int initialFile)
+      : ChessPiece(isWhite, initialRank, initialFile) /*, promotionPieceType(promotionPieceType)*/ {}
+  bool isValidMove(int toRank, int toFile, const ChessBoard& board) const override;
+
+  int getDirection() const { return isWhite ? -1 : 1; }
+
+  bool isOpponentPiece(char piece) const { return (isWhite && islower(piece)) || (!isWhite && isupper(piece)); }
+
+  bool isPawnCaptureMove(int toRank, int toFile, const ChessBoard& board) const;
+
+  void handlePromotion(int toRank, int toFile, ChessBoard& board) const {
+    if ((isWhite && toRank == 0) || (!isWhite && toRank == 7)) {
+      char promotionPiece = getPromotionPieceType();
+      if (promotionPiece != ' ') {
+        board.set(toRank, toFile, promotionPiece);
+      }
+    }
+  }
+};
+
+class Rook : public ChessPiece {
+ public:
+  Rook(bool isWhite, int initialRank, int initialFile) : ChessPiece(isWhite, initialRank, initialFile) {}
+
+  bool isValidMove(int toRank, int toFile, const ChessBoard& board) const override;
+
+  bool isPathClear(int toRank, int toFile, const ChessBoard& board) const;
+};
+
+class Bishop : public ChessPiece {
+ public:
+  Bishop(bool isWhite, int initialRank, int initialFile) : ChessPiece(isWhite, initialRank, initialFile) {}
+
+  bool isValidMove(int toRank, int toFile, const ChessBoard& board) const override;
+};
+
+class Knight : public ChessPiece {
+ public:
+  Knight(bool isWhite, int initialRank, int initialFile) : ChessPiece(isWhite, initialRank, initialFile) {}
+  bool isValidMove(int toRank, int toFile, const ChessBoard& board) const override;
+};
+
+class Queen : public ChessPiece {
+ public:
+  Queen(bool isWhite, int initialRank, int initialFile) : ChessPiece(isWhite, initialRank, initialFile) {}
+
+  bool isValidMove(int toRank, int toFile, const ChessBoard& board) const override;
+};
+
+bool isValidMove(const ChessPiece& piece, int toRank, int toFile, const ChessBoard& board);
+
+// Squares attacked by the piece with the given pieceIndex() standing on `square`. Pawns attack diagonally only.
+inline Bitboard attacksFrom(int piece, int square, Bitboard occupied) {
+  switch (static_cast<PieceKind>(piece % 6)) {
+    case PieceKind::Pawn:
+      return PawnAttacks[piece / 6][square];
+    case PieceKind::Knight:
+      return KnightAttacks[square];
+    case PieceKind::Bishop:
+      return BishopAttacks(square, occupied);
+    case PieceKind::Rook:
+      return RookAttacks(square, occupied);
+    case PieceKind::Queen:
+      return queenAttacks(square, occupied);
+    case PieceKind::King:
+      return KingAttacks[square];
+  }
+  return 0;
+}
+
+// Attack sets of every piece on the board and, per square, the set of squares attacking it.
+// After a move only the pieces on the written squares and the sliders whose rays reached
+// those squares can attack anything different, so update() recomputes just those.
+class AttackMap {
+ public:
+  void rebuild(const ChessBoard& board) {
+    attacks.fill(0);
+    attackers.fill(0);
+    update(board, board.occupied);
+  }
+
+  // Call after the squares in `changed` have been written on `board`.
+  void update(const ChessBoard& board, Bitboard changed) {
+    const Bitboard sliders =
+        board.kindMask(PieceKind::Bishop) | board.kindMask(PieceKind::Rook) | board.kindMask(PieceKind::Queen);
+    Bitboard affected = changed;
+    for (Bitboard squares = changed; squares;) {
+      affected |= attackers[popLowestSquare(squares)] & sliders;
+    }
+    while (affected) {
+      refresh(popLowestSquare(affected), board);
+    }
+  }
+
+  Bitboard attackersOf(int square) const { return attackers[square]; }
+  Bitboard attacksOf(int square) const { return attacks[square]; }
+
+  bool isInCheck(Color color, const ChessBoard& board) const {
+    const Bitboard king = board.piecesOf(color, PieceKind::King);
+    return king && (attackers[__builtin_ctzll(king)] & board.colorMask(opposite(color)));
+  }
+
+ private:
+  void refresh(int square, const ChessBoard& board) {
+    countPiecesExamined(1);
+    const int piece = board.slotAt(square);
+    const Bitboard now = piece < EmptySlot ? attacksFrom(piece, square, board.occupied) : 0;
+    const Bitboard bit = squareBit(square);
+    for (Bitboard lost = attacks[square] & ~now; lost;) {
+      attackers[popLowestSquare(lost)] &= ~bit;
+    }
+    for (Bitboard gained = now & ~attacks[square]; gained;) {
+      attackers[popLowestSquare(gained)] |= bit;
+    }
+    attacks[square] = now;
+  }
+
+  std::array<Bitboard, 64> attacks{};
+  std::array<Bitboard, 64> attackers{};
+};
+
+bool InCheck(const ChessPiece& king, const ChessBoard& board);
+
+// Fixed-size cache from position key (board and side to move) to "side to move is in check".
+// Four entries share a 64-byte bucket; a new entry goes in front and drops the bucket's oldest.
+class VerdictCache {
+ public:
+  static constexpr std::size_t BucketCount = std::size_t{1} << 16;
+
+  VerdictCache() : buckets(BucketCount) {}
+
+  bool probe(std::uint64_t key, bool& inCheck) {
+    for (const Entry& entry : buckets[key & (BucketCount - 1)].entries) {
+      if (entry.used && entry.key == key) {
+        inCheck = entry.inCheck;
+        countVerdictCache(true);
+        return true;
+      }
+    }
+    countVerdictCache(false);
+    return false;
+  }
+
+  void store(std::uint64_t key, bool inCheck) {
+    auto& entries = buckets[key & (BucketCount - 1)].entries;
+    std::copy_backward(entries.begin(), entries.end() - 1, entries.end());
+    entries[0] = Entry{key, inCheck, true};
+  }
+
+ private:
+  struct Entry {
+    std::uint64_t key;
+    bool inCheck;
+    bool used;
+  };
+
+  struct alignas(64) Bucket {
+    std::array<Entry, 4> entries{};
+  };
+
+  std::vector<Bucket> buckets;
+};
+
+enum class Verdict : std::uint8_t { No, Yes, Invalid };
+
+constexpr const char* verdictText(Verdict verdict) {
+  return verdict == Verdict::Yes ? "yes" : verdict == Verdict::No ? "no" : "invalid";
+}
+
+// Squares attacked by each side, indexed by Color, and for every square the pieces of either side attacking it.
+struct AttackSets {
+  std::array<Bitboard, 2> attacked{};
+  std::array<Bitboard, 64> attackers{};
+};
+
+// The side to move's check verdict, refined when it has no legal move.
+enum class GameStatus : std::uint8_t { Normal, Check, Checkmate, Stalemate };
+
+// The first two read like the verdicts they refine.
+constexpr const char* statusText(GameStatus status) {
+  switch (status) {
+    case GameStatus::Normal: return "no";
+    case GameStatus::Check: return "yes";
+    case GameStatus::Checkmate: return "checkmate";
+    case GameStatus::Stalemate: return "stalemate";
+  }
+  return "";
+}
+
+// One game: the board, the side to move, its undo history and the attack map behind its check verdicts.
+// Positions share no mutable state, so any number of threads may each drive their own. A VerdictCache
+// passed in is used without locking and must not be shared by positions living on different threads.
+class Position {
+ public:
+  // Empty board, white to move.
+  Position() = default;
+  explicit Position(VerdictCache* verdictCache) : verdictCache(verdictCache) {}
+
+  // A B line without the B: all 64 squares row by row from a8. White is to move; castling rights,
+  // en passant and the undo history are cleared. A malformed board is Invalid and changes nothing.
+  Verdict loadBoard(std::string_view squares);
+  bool loadFen(const std::string& fen);
+
+  // An M line without the M, e.g. "Pe2e4", "Qd1xd7", "Pb7b8=Q". An illegal move leaves the position as it was.
+  Verdict playMove(std::string_view move);
+  Verdict playMove(Move move);
+
+  // Reads an M line body into a Move; false if it is malformed, names a piece that is not on its square or
+  // gets the promotion suffix wrong. Whether the move is legal is left to playMove(Move).
+  bool parseMove(std::string_view text, Move& move) const;
+  Verdict takeBack(std::size_t plies);
+
+  // Whether the side to move is in check.
+  bool inCheck();
+  GameStatus status();
+  // Read off the attack map, which is only rebuilt if a B line left it stale.
+  AttackSets attackSets();
+
+  std::uint64_t perft(int depth, int threads = 1);
+  std::uint64_t perftDivide(int depth, int threads, std::ostream& out);
+
+  // Appends the board as eight lines of eight squares.
+  void print(std::string& out) const;
+
+  const ChessBoard& getBoard() const { return board; }
+  Color getSideToMove() const { return side; }
+  std::size_t getHistorySize() const { return undoLog.size(); }
+
+  // For a position that moves between threads: switch to the cache of the thread now driving it.
+  void setVerdictCache(VerdictCache* cache) { verdictCache = cache; }
+
+ private:
+  Verdict verdict() { return inCheck() ? Verdict::Yes : Verdict::No; }
+  // The piece rules, the capture flag and promotion, and the own-king test.
+  bool isPlayable(Move move) const;
+
+  ChessBoard board;
+  Color side = Color::White;
+  UndoLog undoLog;
+  AttackMap attackMap;
+  // Cache hits after a B line skip the attack map rebuild; it is only rebuilt when a verdict is missed.
+  bool attackMapStale = true;
+  VerdictCache* verdictCache = nullptr;
+};
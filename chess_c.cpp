@@ -0,0 +1,66 @@
+#include "chess_c.h"
+
+#include <algorithm>
+#include <new>
+
+#include "chess.h"
+
+struct ChessPosition {
+  Position position;
+};
+
+ChessPosition* chess_position_new(void) { return new (std::nothrow) ChessPosition; }
+
+void chess_position_free(ChessPosition* position) { delete position; }
+
+int chess_load_board(ChessPosition* position, const char* squares) {
+  return static_cast<int>(position->position.loadBoard(squares));
+}
+
+int chess_play_move(ChessPosition* position, const char* move) {
+  return static_cast<int>(position->position.playMove(move));
+}
+
+int chess_take_back(ChessPosition* position, size_t plies) {
+  return static_cast<int>(position->position.takeBack(plies));
+}
+
+int chess_load_fen(ChessPosition* position, const char* fen) { return position->position.loadFen(fen); }
+
+int chess_in_check(ChessPosition* position) { return position->position.inCheck(); }
+
+int chess_side_to_move(const ChessPosition* position) {
+  return position->position.getSideToMove() == Color::White ? CHESS_WHITE : CHESS_BLACK;
+}
+
+void chess_board(const ChessPosition* position, char squares[64]) {
+  for (int square = 0; square < 64; ++square) {
+    squares[square] = position->position.getBoard().at(square);
+  }
+}
+
+uint64_t chess_perft(ChessPosition* position, int depth) { return position->position.perft(depth); }
+
+void chess_attacks(ChessPosition* position, uint64_t attacked[2], uint64_t attackers[64]) {
+  const AttackSets sets = position->position.attackSets();
+  if (attacked) {
+    std::copy(sets.attacked.begin(), sets.attacked.end(), attacked);
+  }
+  if (attackers) {
+    std::copy(sets.attackers.begin(), sets.attackers.end(), attackers);
+  }
+}
+
+void chess_check_boards(const char* squares, size_t count, uint8_t* results) {
+  PositionBatch batch;
+  std::vector<size_t> invalid;
+  for (size_t board = 0; board < count; ++board) {
+    if (!batch.add(squares + 64 * board)) {
+      invalid.push_back(board);
+    }
+  }
+  batchCheckStatus(batch, results);
+  for (size_t board : invalid) {
+    results[board] = CHESS_BOARD_INVALID;
+  }
+}
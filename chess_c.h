@@ -0,0 +1,53 @@
+#ifndef CHESS_C_H
+#define CHESS_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One game per handle; handles share nothing, so each thread may drive its own. */
+typedef struct ChessPosition ChessPosition;
+
+enum { CHESS_NO = 0, CHESS_YES = 1, CHESS_INVALID = 2 };
+enum { CHESS_WHITE = 0, CHESS_BLACK = 1 };
+
+/* Empty board, white to move. Returns NULL when out of memory. */
+ChessPosition* chess_position_new(void);
+void chess_position_free(ChessPosition* position);
+
+/* The protocol's B and M lines without the command letter; both return CHESS_NO, CHESS_YES or CHESS_INVALID,
+   the verdict being whether the side to move is in check. */
+int chess_load_board(ChessPosition* position, const char* squares);
+int chess_play_move(ChessPosition* position, const char* move);
+int chess_take_back(ChessPosition* position, size_t plies);
+
+/* Returns 1 on success, 0 when the FEN cannot be read (the position is then unchanged). */
+int chess_load_fen(ChessPosition* position, const char* fen);
+
+int chess_in_check(ChessPosition* position);
+int chess_side_to_move(const ChessPosition* position);
+
+/* Copies the 64 squares, a8 first, as the board chars of the B line (no terminator). */
+void chess_board(const ChessPosition* position, char squares[64]);
+
+uint64_t chess_perft(ChessPosition* position, int depth);
+
+/* Masks with bit n for square n of the B line (a8 = bit 0): attacked[CHESS_WHITE] and attacked[CHESS_BLACK]
+   are the squares each side attacks, attackers[n] the pieces of both sides attacking square n. Either
+   array may be NULL. */
+void chess_attacks(ChessPosition* position, uint64_t attacked[2], uint64_t attackers[64]);
+
+enum { CHESS_WHITE_IN_CHECK = 1, CHESS_BLACK_IN_CHECK = 2, CHESS_BOARD_INVALID = 4 };
+
+/* Checks `count` boards at once, `squares` holding 64 B line chars for each one after the other. Sets
+   results[i] to the CHESS_WHITE_IN_CHECK and CHESS_BLACK_IN_CHECK bits of board i, or to CHESS_BOARD_INVALID. */
+void chess_check_boards(const char* squares, size_t count, uint8_t* results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,198 @@
+#include "generator.h"
+
+#include <string>
+#include <string_view>
+
+#include "chess.h"
+#include "session.h"
+
+enum class GameKind { Opening, Check, Promotion, Captures };
+
+class WorkloadGenerator {
+ public:
+  WorkloadGenerator(const GeneratorOptions& options, OutputWriter& commands, OutputWriter* expected)
+      : options(options), state(options.seed), commands(commands), expected(expected) {}
+
+  void run() {
+    while (emitted < options.lines) {
+      const GameKind kind = static_cast<GameKind>(random(4));
+      playGame(kind);
+    }
+  }
+
+ private:
+  std::uint64_t random(std::uint64_t bound) { return splitMix64(state) % bound; }
+  bool chance(double probability) { return static_cast<double>(splitMix64(state) >> 11) * 0x1.0p-53 < probability; }
+
+  // Writes one line and, through the session, the output it gets.
+  void emit(std::string_view line) {
+    std::string& command = commands.buffer();
+    command += line;
+    command += '\n';
+    commands.commit();
+    if (expected) {
+      session.execute(line, expected->buffer());
+      expected->commit();
+    } else {
+      scratch.clear();
+      session.execute(line, scratch);
+    }
+    ++emitted;
+  }
+
+  void playGame(GameKind kind) {
+    const ChessBoard start = kind == GameKind::Check       ? checkPosition()
+                             : kind == GameKind::Promotion ? promotionPosition()
+                                                           : startPosition();
+    std::string line = "B";
+    for (const ChessBoard::Rank& rank : start.squares) {
+      line.append(rank.data(), rank.size());
+    }
+    emit(line);
+
+    const int plies = kind == GameKind::Opening || kind == GameKind::Captures ? 10 + random(70) : random(8);
+    for (int ply = 0; ply < plies && emitted < options.lines; ++ply) {
+      const Position& position = session.getPosition();
+      MoveList moves;
+      generateLegalMoves(position.getBoard(), position.getSideToMove(), moves);
+      if (moves.size() == 0) {
+        break;
+      }
+      if (chance(options.invalidFraction)) {
+        emit("M" + invalidMove(moves));
+      } else {
+        emit("M" + moveToText(position.getBoard(), pickMove(kind, moves)));
+      }
+      if (chance(0.01) && emitted < options.lines) {
+        emit(chance(0.5) ? "print" : "U");
+      }
+    }
+  }
+
+  // Captures and promotions are taken whenever there is one in the games built around them.
+  Move pickMove(GameKind kind, const MoveList& moves) {
+    MoveList preferred;
+    for (Move move : moves) {
+      if ((kind == GameKind::Captures && isCapture(move)) ||
+          (kind == GameKind::Promotion && movePromotion(move) != PieceKind::Pawn)) {
+        preferred.add(move);
+      }
+    }
+    const MoveList& from = preferred.size() ? preferred : moves;
+    return from.moves[random(from.size())];
+  }
+
+  // An M line body that cannot be played here: a legal move under another piece letter, a piece sent to a
+  // square it cannot reach, a promotion without its suffix, or text that is not a move at all.
+  std::string invalidMove(const MoveList& moves) {
+    const ChessBoard& board = session.getPosition().getBoard();
+    const Move move = moves.moves[random(moves.size())];
+    std::string text = moveToText(board, move);
+    switch (random(4)) {
+      case 0: {
+        const bool white = isupper(text[0]);
+        const PieceKind kind = static_cast<PieceKind>(pieceIndex(text[0]) % 6);
+        text[0] = pieceChar(white, static_cast<PieceKind>((static_cast<int>(kind) + 1 + random(5)) % 6));
+        return text;
+      }
+      case 1:
+        for (int attempt = 0; attempt < 8; ++attempt) {
+          const int to = static_cast<int>(random(64));
+          bool legal = false;
+          for (Move other : moves) {
+            legal |= moveFrom(other) == moveFrom(move) && moveTo(other) == to;
+          }
+          if (!legal && to != moveFrom(move)) {
+            return moveToText(board, encodeMove(moveFrom(move), to, PieceKind::Pawn, board.at(to) != ' '));
+          }
+        }
+        return text.substr(0, 3) + "9";
+      case 2:
+        if (movePromotion(move) != PieceKind::Pawn) {
+          return text.substr(0, text.find('='));
+        }
+        return text + (isupper(text[0]) ? "=Q" : "=q");
+      default:
+        return text.substr(0, 3) + "9";
+    }
+  }
+
+  ChessBoard startPosition() {
+    ChessBoard board;
+    Color side;
+    loadFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", board, side);
+    return board;
+  }
+
+  int randomEmptySquare(const ChessBoard& board, Bitboard allowed = ~Bitboard{0}) {
+    const Bitboard empty = ~board.occupied & allowed;
+    for (;;) {
+      const int square = static_cast<int>(random(64));
+      if (empty & squareBit(square)) {
+        return square;
+      }
+    }
+  }
+
+  // Two kings and a few pieces, usually with a black piece aimed at the white king. Black is never in check,
+  // as white is to move.
+  ChessBoard checkPosition() {
+    constexpr Bitboard PawnRanks = ~(Bitboard{0xFF} | Bitboard{0xFF} << 56);
+    for (;;) {
+      ChessBoard board;
+      const int whiteKing = static_cast<int>(random(64));
+      board.set(whiteKing, 'K');
+      board.set(randomEmptySquare(board, ~KingAttacks[whiteKing]), 'k');
+      for (int count = 2 + random(7); count > 0; --count) {
+        const char piece = "PNBRQpnbrq"[random(10)];
+        board.set(randomEmptySquare(board, piece == 'P' || piece == 'p' ? PawnRanks : ~Bitboard{0}), piece);
+      }
+      if (chance(0.7)) {
+        const char checker = "nbrq"[random(4)];
+        const Bitboard squares = attacksFrom(pieceIndex(checker), whiteKing, board.occupied) & ~board.occupied;
+        if (squares) {
+          Bitboard left = squares;
+          for (int skip = random(__builtin_popcountll(squares)); skip > 0; --skip) {
+            left &= left - 1;
+          }
+          board.set(__builtin_ctzll(left), checker);
+        }
+      }
+      if (!isInCheck(Color::Black, board)) {
+        return board;
+      }
+    }
+  }
+
+  // Kings and pawns one step from promoting, with pieces to capture on the last ranks.
+  ChessBoard promotionPosition() {
+    for (;;) {
+      ChessBoard board;
+      board.set(randomEmptySquare(board, Bitboard{0xFF} << 32), 'K');
+      board.set(randomEmptySquare(board, Bitboard{0xFF} << 24), 'k');
+      for (int count = 1 + random(3); count > 0; --count) {
+        board.set(randomEmptySquare(board, Bitboard{0xFF} << 8), 'P');
+        board.set(randomEmptySquare(board, Bitboard{0xFF} << 48), 'p');
+      }
+      for (int count = random(4); count > 0; --count) {
+        board.set(randomEmptySquare(board, Bitboard{0xFF}), "nbrq"[random(4)]);
+        board.set(randomEmptySquare(board, Bitboard{0xFF} << 56), "NBRQ"[random(4)]);
+      }
+      if (!isInCheck(Color::Black, board)) {
+        return board;
+      }
+    }
+  }
+
+  const GeneratorOptions& options;
+  std::uint64_t state;
+  OutputWriter& commands;
+  OutputWriter* expected;
+  Session session;
+  std::string scratch;
+  std::uint64_t emitted = 0;
+};
+
+void generateWorkload(const GeneratorOptions& options, OutputWriter& commands, OutputWriter* expected) {
+  WorkloadGenerator(options, commands, expected).run();
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+#include "output.h"
+
+struct GeneratorOptions {
+  std::uint64_t seed = 1;
+  std::uint64_t lines = 1000000;
+  // Share of M lines that are made invalid on purpose.
+  double invalidFraction = 0.1;
+};
+
+// Writes a reproducible command stream of `options.lines` lines: legal games from the start position, check
+// positions, promotion positions and capture-heavy games, each a B line followed by M lines, with a print or a
+// takeback now and then. The same seed gives the same stream. When `expected` is given, it receives the output
+// each line gets from a Session, so a run over the stream can be compared against it.
+void generateWorkload(const GeneratorOptions& options, OutputWriter& commands, OutputWriter* expected);
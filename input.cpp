@@ -0,0 +1,89 @@
+#include "input.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+LineReader::LineReader(const char* path) {
+  if (std::string(path) == "-") {
+    fd = STDIN_FILENO;
+  } else {
+    fd = open(path, O_RDONLY);
+    ownsFd = true;
+  }
+  if (fd < 0) {
+    return;
+  }
+
+  struct stat status;
+  if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+    void* address = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address != MAP_FAILED) {
+      madvise(address, status.st_size, MADV_SEQUENTIAL);
+      mapping = address;
+      mappingSize = status.st_size;
+      pending = std::string_view(static_cast<const char*>(mapping), mappingSize);
+      endOfInput = true;
+      return;
+    }
+  }
+  buffer.resize(BufferBytes);
+  pending = std::string_view(buffer.data(), 0);
+}
+
+LineReader::~LineReader() {
+  if (mapping) {
+    munmap(mapping, mappingSize);
+  }
+  if (ownsFd && fd >= 0) {
+    close(fd);
+  }
+}
+
+bool LineReader::next(std::string_view& line) {
+  for (;;) {
+    std::string_view rest = pending;
+    const bool found = nextLine(rest, line);
+    // A line is only whole once its '\n' has been read, or when nothing more will come.
+    if ((found && line.data() + line.size() < pending.data() + pending.size()) || endOfInput) {
+      pending = rest;
+      return found;
+    }
+    if (!found) {
+      pending.remove_prefix(pending.size());
+    }
+    if (!refill()) {
+      endOfInput = true;
+    }
+  }
+}
+
+std::string_view LineReader::peek(std::size_t count) {
+  while (pending.size() < count && !endOfInput) {
+    if (!refill()) {
+      endOfInput = true;
+    }
+  }
+  return pending.substr(0, count);
+}
+
+bool LineReader::refill() {
+  const std::size_t kept = pending.size();
+  std::memmove(buffer.data(), pending.data(), kept);
+  if (kept == buffer.size()) {
+    buffer.resize(buffer.size() * 2);
+  }
+  for (;;) {
+    const ssize_t count = read(fd, buffer.data() + kept, buffer.size() - kept);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    pending = std::string_view(buffer.data(), kept + (count > 0 ? count : 0));
+    return count > 0;
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Takes the next line off the front of `text`: leading whitespace, blank lines included, is skipped
+// like `std::getline(in >> std::ws, line)` does, and the line excludes its '\n'. False once only
+// whitespace is left.
+inline bool nextLine(std::string_view& text, std::string_view& line) {
+  std::size_t begin = 0;
+  while (begin < text.size() && (text[begin] == ' ' || (text[begin] >= '\t' && text[begin] <= '\r'))) {
+    ++begin;
+  }
+  if (begin == text.size()) {
+    text = {};
+    return false;
+  }
+  const std::size_t end = text.find('\n', begin);
+  line = text.substr(begin, end == std::string_view::npos ? std::string_view::npos : end - begin);
+  text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+  return true;
+}
+
+// The command input as lines, without copying them. A regular file is mapped into memory whole; anything
+// else (a pipe, a terminal, "-" for stdin) is read through a large buffer. A line stays valid until the
+// next call, and for as long as the reader lives when isMapped().
+class LineReader {
+ public:
+  static constexpr std::size_t BufferBytes = std::size_t{1} << 20;
+
+  explicit LineReader(const char* path);
+  ~LineReader();
+  LineReader(const LineReader&) = delete;
+  LineReader& operator=(const LineReader&) = delete;
+
+  bool isOpen() const { return fd >= 0; }
+  bool isMapped() const { return mapping != nullptr; }
+
+  bool next(std::string_view& line);
+
+  // Raw access for binary input: up to `count` bytes from the current position, fewer only at the end
+  // of the input. Valid until the next call.
+  std::string_view peek(std::size_t count);
+  void skip(std::size_t count) { pending.remove_prefix(count); }
+
+ private:
+  // Reads more input behind the unconsumed part of the buffer; false at end of input.
+  bool refill();
+
+  int fd = -1;
+  bool ownsFd = false;
+  void* mapping = nullptr;
+  std::size_t mappingSize = 0;
+  // The mapped file, or the part of the buffer not yet handed out.
+  std::string_view pending;
+  std::vector<char> buffer;
+  bool endOfInput = false;
+};
@@ -1,732 +1,207 @@
-#include <array>
-#include <cctype>
-#include <cmath>
-#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
-#include <sstream>
-#include <stack>
+#include <memory>
 #include <string>
-#include <tuple>
-#include <vector>
-
-using ChessBoard = std::array<std::array<char, 8>, 8>;
-
-std::stack<std::tuple<ChessBoard, bool>> previousBoards;
-
-ChessBoard SchachBrett = {{
-    {'r', 'n', 'b', 'q', 'k', 'b', 'n', 'r'},
-    {'p', 'p', 'p', 'p', 'p', 'p', 'p', 'p'},
-    {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '},
-    {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '},
-    {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '},
-    {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '},
-    {'P', 'P', 'P', 'P', 'P', 'P', 'P', 'P'},
-    {'R', 'N', 'B', 'Q', 'K', 'B', 'N', 'R'},
-}};
-
-bool isValidPromotionPiece(char piece) {
-  return (piece == 'Q' || piece == 'N' || piece == 'R' || piece == 'B' || piece == 'q' || piece == 'n' ||
-          piece == 'r' || piece == 'b');
-}
-
-bool isValidSquare(int rank, int file) { return (rank >= 1 && rank <= 8 && file >= 1 && file <= 8); }
-
-inline bool whitesTurn = true;
-
-bool isValidPiece(char piece) {
-  return whitesTurn ? (piece == 'P' || piece == 'K' || piece == 'N' || piece == 'R' || piece == 'Q' || piece == 'B')
-                    : (piece == 'p' || piece == 'k' || piece == 'n' || piece == 'r' || piece == 'q' || piece == 'b');
-}
-
-inline bool isValidMove2(int fromRank, int fromFile, char piece) {
-  return SchachBrett[fromRank][fromFile] == piece && isValidPiece(piece);
-}
-
-inline bool isCaptureMove(int toRank, int toFile) { return SchachBrett[toRank][toFile] != ' '; }
-
-inline bool isSameColor(char piece1, char piece2) {
-  return (piece1 >= 'a' && piece1 <= 'z' && piece2 >= 'a' && piece2 <= 'z') ||
-         (piece1 >= 'A' && piece1 <= 'Z' && piece2 >= 'A' && piece2 <= 'Z');
-}
-
-inline void switchTurn() { whitesTurn = !whitesTurn; }
-
-void promotePawn(int toRank, int toFile, char promotionPiece) {
-  if (isValidSquare(toRank, toFile) && (whitesTurn ? toRank == 0 : toRank == 7)) {
-    SchachBrett[toRank][toFile] = promotionPiece;
-  }
-}
-
-void convertInput(const std::string& input, int& fromRank, int& fromFile, int& toRank, int& toFile) {
-  fromFile = input[1] - 'a';
-  fromRank = 8 - (input[2] - '0');
-
-  char piece = input[0];
-
-  if (!isValidPiece(piece)) {
-    fromRank = fromFile = toRank = toFile = -1;
-    return;
-  }
-
-  if (input[3] == 'x') {
-    toFile = input[4] - 'a';
-    toRank = 8 - (input[5] - '0');
-  } else {
-    toFile = input[3] - 'a';
-    toRank = 8 - (input[4] - '0');
-  }
-
-  int rankDiff = std::abs(toRank - fromRank);
-  int fileDiff = std::abs(toFile - fromFile);
-
-  if ((piece == 'B' || piece == 'b') && rankDiff != fileDiff) {
-    fromRank = fromFile = toRank = toFile = -1;
-  }
-
-  std::string promotionString = input.substr(input.find('=') + 1);
-  char promotionPiece = promotionString.empty() ? ' ' : promotionString[0];
-}
-
-class ChessPiece {
- public:
-  ChessPiece(bool isWhite, int initialRank, int initialFile)
-      : isWhite(isWhite), currentRank(initialRank), currentFile(initialFile) {}
-
-  virtual bool isValidMove(int toRank, int toFile, const ChessBoard& board) const = 0;
-
-  bool isOpponentPiece(char piece) const { return (isWhite && islower(piece)) || (!isWhite && isupper(piece)); }
-
-  int getRank() const { return currentRank; }
-  int getFile() const { return currentFile; }
-  int getPieceType() const { return currentRank + currentFile; }
-
-  bool isWhite;
-  int currentRank;
-  int currentFile;
-};
-
-class King : public ChessPiece {
- public:
-  King(bool isWhite, int initialRank, int initialFile) : ChessPiece(isWhite, initialRank, initialFile) {}
-
-  bool isValidMove(int toRank, int toFile, const ChessBoard& board) const override;
-};
-
-class Pawn : public ChessPiece {
- public:
-  char promotionPieceType = ' ';
-  char getPromotionPieceType() const { return promotionPieceType; }
-  void setPromotionPieceType(char promotionPiece) { promotionPieceType = promotionPiece; }
-  Pawn(bool isWhite, int initialRank, int initialFile)
-      : ChessPiece(isWhite, initialRank, initialFile) /*, promotionPieceType(promotionPieceType)*/ {}
-  bool isValidMove(int toRank, int toFile, const ChessBoard& board) const override;
-
-  int getDirection() const { return isWhite ? -1 : 1; }
-
-  bool isOpponentPiece(char piece) const { return (isWhite && islower(piece)) || (!isWhite && isupper(piece)); }
-
-  bool isPawnCaptureMove(int toRank, int toFile, const ChessBoard& board) const;
-
-  bool isValidForwardMove(int rankDiff, const ChessBoard& board) const;
-
-  bool isValidDoubleMove(int rankDiff, const ChessBoard& board) const;
-  void handlePromotion(int toRank, int toFile, const ChessBoard& board) const {
-    if ((isWhite && toRank == 0) || (!isWhite && toRank == 7)) {
-      char promotionPiece = getPromotionPieceType();
-      if (promotionPiece != ' ') {
-        SchachBrett[toRank][toFile] = promotionPiece;
-      }
-    }
-  }
-};
-
-class Rook : public ChessPiece {
- public:
-  Rook(bool isWhite, int initialRank, int initialFile) : ChessPiece(isWhite, initialRank, initialFile) {}
-
-  bool isValidMove(int toRank, int toFile, const ChessBoard& board) const override;
-
-  bool isPathClear(int toRank, int toFile, const ChessBoard& board) const;
-};
-
-class Bishop : public ChessPiece {
- public:
-  Bishop(bool isWhite, int initialRank, int initialFile) : ChessPiece(isWhite, initialRank, initialFile) {}
-
-  bool isValidMove(int toRank, int toFile, const ChessBoard& board) const override;
-};
-
-class Knight : public ChessPiece {
- public:
-  Knight(bool isWhite, int initialRank, int initialFile) : ChessPiece(isWhite, initialRank, initialFile) {}
-  bool isValidMove(int toRank, int toFile, [[maybe_unused]] const ChessBoard& board) const override;
+#include <string_view>
+#include <thread>
+
+#include "binary.h"
+#include "chess.h"
+#include "generator.h"
+#include "input.h"
+#include "output.h"
+#include "server.h"
+#include "session.h"
+#include "stats.h"
+
+struct PerftReference {
+  const char* name;
+  const char* fen;
+  int depth;
+  std::uint64_t nodes;
 };
 
-class Queen : public ChessPiece {
- public:
-  Queen(bool isWhite, int initialRank, int initialFile) : ChessPiece(isWhite, initialRank, initialFile) {}
-
-  bool isValidMove(int toRank, int toFile, const ChessBoard& board) const override;
-};
-
-bool King::isValidMove(int toRank, int toFile, const ChessBoard& board) const {
-  if (toRank < 0 || toRank >= 8 || toFile < 0 || toFile >= 8) {
-    return false;
-  }
-
-  int rankDiff = std::abs(toRank - currentRank);
-  int fileDiff = std::abs(toFile - currentFile);
-
-  if ((rankDiff == 1 && fileDiff <= 1) || (rankDiff <= 1 && fileDiff == 1)) {
-    return board[toRank][toFile] == ' ' || isOpponentPiece(board[toRank][toFile]);
-  }
-
-  return false;
-}
-
-bool Pawn::isValidForwardMove(int rankDiff, const ChessBoard& board) const {
-  if (isWhite && rankDiff == -1 && board[currentRank - 1][currentFile] == ' ') {
-    return true;
-  } else if (!isWhite && rankDiff == 1 && board[currentRank + 1][currentFile] == ' ') {
-    return true;
-  }
-  return false;
-}
-
-bool Pawn::isValidDoubleMove(int rankDiff, const ChessBoard& board) const {
-  if ((isWhite && currentRank == 6 && std::abs(rankDiff) == 2 &&
-       board[currentRank + rankDiff / 2][currentFile] == ' ' && board[currentRank + rankDiff][currentFile] == ' ') ||
-      (!isWhite && currentRank == 1 && std::abs(rankDiff) == 2 &&
-       board[currentRank + rankDiff / 2][currentFile] == ' ' && board[currentRank + rankDiff][currentFile] == ' ')) {
-    return true;
-  }
-  return false;
-}
-
-bool Pawn::isValidMove(int toRank, int toFile, const ChessBoard& board) const {
-  if (toRank < 0 || toRank >= 8 || toFile < 0 || toFile >= 8) {
-    return false;
-  }
-
-  int rankDiff = toRank - currentRank;
-  int fileDiff = std::abs(toFile - currentFile);
-
-  char targetPiece = board[toRank][toFile];
-
-  if (fileDiff == 1 && rankDiff == getDirection()) {
-    if (targetPiece != ' ' && isOpponentPiece(targetPiece)) {
-      return true;
-    }
-  }
-
-  if (fileDiff == 0) {
-    if (isValidForwardMove(rankDiff, board) && toFile == currentFile) {
-      return true;
-    }
-    if (isValidDoubleMove(rankDiff, board) && toFile == currentFile) {
-      return true;
-    }
-  }
-  return false;
-}
-
-/*bool Pawn::isPawnCaptureMove(int toRank, int toFile, const ChessBoard& board) const {
-  if (!isValidSquare(toRank, toFile)) {
-    return false;
-  }
-
-  char targetPiece = board[toRank][toFile];
-
-  if (targetPiece != ' ' && isOpponentPiece(targetPiece)) {
-    int rankDiff = abs(toRank - getRank());
-    int fileDiff = abs(toFile - getFile());
-
-    if (rankDiff == 1 && fileDiff == 1) {
-      return true;
-    }
-  }
-
-  return false;
-}*/
-
-bool Rook::isValidMove(int toRank, int toFile, const ChessBoard& board) const {
-  if (toRank < 0 || toRank >= 8 || toFile < 0 || toFile >= 8) {
-    return false;
-  }
-
-  int rankDiff = std::abs(toRank - currentRank);
-  int fileDiff = std::abs(toFile - currentFile);
+// Published node counts (chessprogramming.org "Perft Results").
+constexpr std::array<PerftReference, 6> PerftSuite = {{
+    {"startpos", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5, 4865609},
+    {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, 4085603},
+    {"position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, 674624},
+    {"position4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4, 422333},
+    {"position5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4, 2103487},
+    {"position6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594},
+}};
 
-  if ((rankDiff > 0 && fileDiff == 0) || (rankDiff == 0 && fileDiff > 0)) {
-    if (isPathClear(toRank, toFile, board)) {
-      return board[toRank][toFile] == ' ' || isOpponentPiece(board[toRank][toFile]);
+// Runs the reference positions and reports nodes/sec; fails if any count differs from the published one.
+int runPerftSuite(int threads) {
+  bool passed = true;
+  std::uint64_t totalNodes = 0;
+  double totalSeconds = 0;
+  for (const PerftReference& reference : PerftSuite) {
+    ChessBoard board;
+    Color side;
+    loadFen(reference.fen, board, side);
+    const auto start = std::chrono::steady_clock::now();
+    std::uint64_t nodes = 0;
+    for (const auto& divide : perftByRootMove(board, side, reference.depth, threads)) {
+      nodes += divide.second;
     }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    totalNodes += nodes;
+    totalSeconds += seconds;
+    passed &= nodes == reference.nodes;
+    std::cout << reference.name << " depth " << reference.depth << ": " << nodes
+              << (nodes == reference.nodes ? " ok " : " MISMATCH ") << static_cast<std::uint64_t>(nodes / seconds)
+              << " nodes/s\n";
   }
-
-  return false;
+  std::cout << "total: " << totalNodes << " nodes, " << static_cast<std::uint64_t>(totalNodes / totalSeconds)
+            << " nodes/s\n";
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-bool Rook::isPathClear(int toRank, int toFile, const ChessBoard& board) const {
-  int rankDiff = toRank - currentRank;
-  int fileDiff = toFile - currentFile;
-
-  if (rankDiff != 0) {
-    int rankStep = (rankDiff > 0) ? 1 : -1;
-    for (int rank = currentRank + rankStep; rank != toRank; rank += rankStep) {
-      if (board[rank][currentFile] != ' ') {
-        // std::cout << "Path not clear at: " << rank << ", " << currentFile << std::endl;
-        return false;
+int main(int argc, char* argv[]) {
+  const char* path = nullptr;
+  bool bench = false;
+  int threads = 1;
+  int jobs = 1;
+  const char* socketPath = nullptr;
+  bool toBinary = false;
+  bool toText = false;
+  bool reportStatus = false;
+  bool stats = false;
+  bool statsJson = false;
+  double statsInterval = 0;
+  bool generate = false;
+  GeneratorOptions generatorOptions;
+  const char* expectedPath = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+    if (argument == "--threads" && i + 1 < argc) {
+      threads = std::atoi(argv[++i]);
+      if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
       }
-    }
-  } else if (fileDiff != 0) {
-    int fileStep = (fileDiff > 0) ? 1 : -1;
-    for (int file = currentFile + fileStep; file != toFile; file += fileStep) {
-      if (board[currentRank][file] != ' ') {
-        // std::cout << "Path not clear at: " << file << ", " << currentRank << std::endl;
-        return false;
+    } else if (argument == "--jobs" && i + 1 < argc) {
+      jobs = std::atoi(argv[++i]);
+      if (jobs <= 0) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
       }
+    } else if (argument == "--serve" && i + 1 < argc) {
+      socketPath = argv[++i];
+    } else if (argument == "--to-binary") {
+      toBinary = true;
+    } else if (argument == "--to-text") {
+      toText = true;
+    } else if (argument == "--status") {
+      reportStatus = true;
+    } else if (argument == "--stats" || argument == "--stats-json") {
+      stats = true;
+      statsJson = argument == "--stats-json";
+    } else if (argument == "--stats-interval" && i + 1 < argc) {
+      stats = true;
+      statsInterval = std::atof(argv[++i]);
+    } else if (argument == "--generate" && i + 1 < argc) {
+      generate = true;
+      generatorOptions.lines = std::strtoull(argv[++i], nullptr, 10);
+    } else if (argument == "--seed" && i + 1 < argc) {
+      generatorOptions.seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (argument == "--invalid" && i + 1 < argc) {
+      generatorOptions.invalidFraction = std::atof(argv[++i]);
+    } else if (argument == "--expected" && i + 1 < argc) {
+      expectedPath = argv[++i];
+    } else if (argument == "--bench") {
+      bench = true;
+    } else if (!path) {
+      path = argv[i];
+    } else {
+      return EXIT_FAILURE;
     }
   }
 
-  return true;
-}
-
-bool Bishop::isValidMove(int toRank, int toFile, const ChessBoard& board) const {
-  if (toRank < 0 || toRank >= 8 || toFile < 0 || toFile >= 8) {
-    return false;
+  if (bench) {
+    return runPerftSuite(threads);
   }
-
-  int rankDiff = toRank - currentRank;
-  int fileDiff = toFile - currentFile;
-
-  if (std::abs(rankDiff) != std::abs(fileDiff)) {
-    return false;
+  if (stats && !StatsEnabled) {
+    std::cerr << "stats: not compiled in, build with -DCHESS_STATS\n";
   }
-
-  int rankStep = (rankDiff > 0) ? 1 : -1;
-  int fileStep = (fileDiff > 0) ? 1 : -1;
-
-  for (int rank = currentRank + rankStep, file = currentFile + fileStep; rank != toRank && file != toFile;
-       rank += rankStep, file += fileStep) {
-    if (board[rank][file] != ' ') {
-      return false;
-    }
+  // Declared before the output so that its last report comes after the output is flushed.
+  std::unique_ptr<StatsReporter> statsReporter;
+  if (stats && StatsEnabled) {
+    statsReporter = std::make_unique<StatsReporter>(statsJson, statsInterval, std::cerr);
   }
-
-  return true;
-}
-
-bool Knight::isValidMove(int toRank, int toFile, [[maybe_unused]] const ChessBoard& board) const {
-  if (toRank < 0 || toRank >= 8 || toFile < 0 || toFile >= 8) {
-    return false;
-  }
-  int rankDiff = std::abs(toRank - currentRank);
-  int fileDiff = std::abs(toFile - currentFile);
-
-  return (rankDiff == 2 && fileDiff == 1) || (rankDiff == 1 && fileDiff == 2);
-}
-
-bool Queen::isValidMove(int toRank, int toFile, const ChessBoard& board) const {
-  if (toRank < 0 || toRank >= 8 || toFile < 0 || toFile >= 8) {
-    return false;
-  }
-
-  int rankDiff = std::abs(toRank - currentRank);
-  int fileDiff = std::abs(toFile - currentFile);
-
-  if ((rankDiff == 0 || fileDiff == 0 || rankDiff == fileDiff) &&
-      (board[toRank][toFile] == ' ' || (isWhite ? islower(board[toRank][toFile]) : isupper(board[toRank][toFile])))) {
-    int rankStep = (toRank > currentRank) ? 1 : (toRank < currentRank) ? -1 : 0;
-    int fileStep = (toFile > currentFile) ? 1 : (toFile < currentFile) ? -1 : 0;
-
-    for (int rank = currentRank + rankStep, file = currentFile + fileStep; rank != toRank || file != toFile;
-         rank += rankStep, file += fileStep) {
-      if (board[rank][file] != ' ') {
-        return false;
-      }
+  if (generate) {
+    const int expectedFd = expectedPath ? open(expectedPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+    if (expectedPath && expectedFd < 0) {
+      return EXIT_FAILURE;
     }
-
-    return true;
-  }
-
-  return false;
-}
-
-bool isValidMove(const ChessPiece& piece, int toRank, int toFile, const ChessBoard& board) {
-  return piece.isValidMove(toRank, toFile, board);
-}
-
-bool InCheck(const ChessPiece& king, const ChessBoard& board) {
-  int kingRank = king.getRank();
-  int kingFile = king.getFile();
-
-  for (int rank = 0; rank < 8; ++rank) {
-    for (int file = 0; file < 8; ++file) {
-      char piece = board[rank][file];
-
-      if (king.isOpponentPiece(piece) && isValidPiece(piece)) {
-        ChessPiece* opponentPiece = nullptr;
-
-        switch (piece) {
-          case 'K':
-            opponentPiece = new King(true, rank, file);
-            break;
-          case 'Q':
-            opponentPiece = new Queen(true, rank, file);
-            break;
-          case 'P':
-            opponentPiece = new Pawn(true, rank, file);
-            break;
-          case 'R':
-            opponentPiece = new Rook(true, rank, file);
-            break;
-          case 'B':
-            opponentPiece = new Bishop(true, rank, file);
-            break;
-          case 'N':
-            opponentPiece = new Knight(true, rank, file);
-            break;
-          case 'k':
-            opponentPiece = new King(false, rank, file);
-            break;
-          case 'q':
-            opponentPiece = new Queen(false, rank, file);
-            break;
-          case 'p':
-            opponentPiece = new Pawn(false, rank, file);
-            break;
-          case 'r':
-            opponentPiece = new Rook(false, rank, file);
-            break;
-          case 'b':
-            opponentPiece = new Bishop(false, rank, file);
-            break;
-          case 'n':
-            opponentPiece = new Knight(false, rank, file);
-            break;
-          default:
-            break;
-        }
-
-        if (opponentPiece && isValidMove(*opponentPiece, kingRank, kingFile, board)) {
-          delete opponentPiece;
-          return true;
-        }
-
-        delete opponentPiece;
+    {
+      OutputWriter commands(STDOUT_FILENO);
+      std::unique_ptr<OutputWriter> expected;
+      if (expectedFd >= 0) {
+        expected = std::make_unique<OutputWriter>(expectedFd);
       }
+      generateWorkload(generatorOptions, commands, expected.get());
     }
+    if (expectedFd >= 0) {
+      close(expectedFd);
+    }
+    return EXIT_SUCCESS;
   }
-
-  return false;
-}
-
-int main(int argc, char* argv[]) {
-  if (argc != 2) {
+  if (socketPath) {
+    return SessionServer(socketPath, jobs, threads, reportStatus).run() ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if (!path) {
     return EXIT_FAILURE;
   }
 
-  std::ifstream inputFile(argv[1]);
+  LineReader inputFile(path);
 
-  if (!inputFile.is_open()) {
+  if (!inputFile.isOpen()) {
     return EXIT_FAILURE;
   }
-  int fromRank, fromFile, toRank, toFile;
-  std::string boardConfiguration;
-
-  Queen whiteQueen(true, 7, 3);
-  whiteQueen.currentRank = 7;
-  whiteQueen.currentFile = 3;
-
-  Queen blackQueen(false, 0, 3);
-  blackQueen.currentRank = 0;
-  blackQueen.currentFile = 3;
 
-  King whiteKing(true, 7, 4);
-  whiteKing.currentRank = 7;
-  whiteKing.currentFile = 4;
+  OutputWriter output(STDOUT_FILENO);
 
-  King blackKing(false, 0, 4);
-  blackKing.currentRank = 0;
-  blackKing.currentFile = 4;
-
-  Pawn whitePawns[8] = {Pawn(true, 6, 0), Pawn(true, 6, 1), Pawn(true, 6, 2), Pawn(true, 6, 3),
-                        Pawn(true, 6, 4), Pawn(true, 6, 5), Pawn(true, 6, 6), Pawn(true, 6, 7)};
-
-  for (int i = 0; i < 8; ++i) {
-    whitePawns[i] = Pawn(true, 6, i);
+  if (toBinary) {
+    convertToBinary(inputFile, output);
+    return EXIT_SUCCESS;
   }
-
-  Pawn blackPawns[8] = {Pawn(false, 1, 0), Pawn(false, 1, 1), Pawn(false, 1, 2), Pawn(false, 1, 3),
-                        Pawn(false, 1, 4), Pawn(false, 1, 5), Pawn(false, 1, 6), Pawn(false, 1, 7)};
-  for (int i = 0; i < 8; ++i) {
-    blackPawns[i] = Pawn(false, 1, i);
+  if (toText) {
+    return convertToText(inputFile, output) ? EXIT_SUCCESS : EXIT_FAILURE;
   }
 
-  Rook whiteRooks[2] = {Rook(true, 7, 0), Rook(true, 7, 7)};
-  for (int i = 0; i < 2; ++i) {
-    whiteRooks[i].currentRank = 7;
-    whiteRooks[i].currentFile = i * 7;
-  }
+  VerdictCache verdictCache;
+  Session session(&verdictCache, threads, reportStatus);
 
-  Rook blackRooks[2] = {Rook(false, 0, 0), Rook(false, 0, 7)};
-  for (int i = 0; i < 2; ++i) {
-    blackRooks[i].currentRank = 0;
-    blackRooks[i].currentFile = i * 7;
-  }
-  Bishop whiteBishops[2] = {Bishop(true, 7, 2), Bishop(true, 7, 5)};
-  for (int i = 0; i < 2; ++i) {
-    whiteBishops[i].currentRank = 7;
-    whiteBishops[i].currentFile = 2 + 3 * i;
+  // Binary input always runs serially: its records cannot be cut into shards without decoding them.
+  if (isBinaryInput(inputFile)) {
+    const bool complete = runBinary(inputFile, session, output);
+    output.flush();
+    return complete ? EXIT_SUCCESS : EXIT_FAILURE;
   }
 
-  Bishop blackBishops[2] = {Bishop(false, 0, 2), Bishop(false, 0, 5)};
-  for (int i = 0; i < 2; ++i) {
-    blackBishops[i].currentRank = 0;
-    blackBishops[i].currentFile = 2 + 3 * i;
-  }
-  Knight whiteKnights[2] = {Knight(true, 7, 1), Knight(true, 7, 6)};
-  for (int i = 0; i < 2; ++i) {
-    whiteKnights[i].currentRank = 7;
-    whiteKnights[i].currentFile = 1 + 5 * i;
+  if (jobs > 1) {
+    ShardedRunner(jobs, reportStatus).run(inputFile, output);
+    return EXIT_SUCCESS;
   }
 
-  Knight blackKnights[2] = {Knight(false, 0, 1), Knight(false, 0, 6)};
-  for (int i = 0; i < 2; ++i) {
-    blackKnights[i].currentRank = 0;
-    blackKnights[i].currentFile = 1 + 5 * i;
-  }
-
-  ChessBoard SchachBrett;
-
-  std::stack<std::tuple<ChessBoard, bool>> previousBoards;
+  std::string_view input;
 
-  std::string input;
-
-  while (std::getline(inputFile >> std::ws, input)) {
-    if (input[0] == 'B') {
-      std::string boardConfiguration = input.substr(1);
-      int k = 0;
-      for (int i = 0; i < 8 && k < boardConfiguration.size(); ++i) {
-        for (int j = 0; j < 8 && k < boardConfiguration.size(); ++j) {
-          if (boardConfiguration[k] != ' ') {
-            SchachBrett[i][j] = boardConfiguration[k];
-          } else {
-            SchachBrett[i][j] = ' ';
-          }
-          k++;
-        }
-      }
-      if (InCheck(whiteKing, SchachBrett) || InCheck(blackKing, SchachBrett)) {
-        std::cout << "yes\n";
-      }
-      if (!InCheck(whiteKing, SchachBrett) && !InCheck(blackKing, SchachBrett)) {
-        std::cout << "no\n";
-      }
-    }
-
-    if (input[0] == 'M') {
-      input = input.substr(1);
-      convertInput(input, fromRank, fromFile, toRank, toFile);
-
-      ChessPiece* piece = nullptr;
-      switch (SchachBrett[fromRank][fromFile]) {
-        case 'K':
-          piece = &whiteKing;
-          break;
-        case 'k':
-          piece = &blackKing;
-          break;
-        case 'Q':
-          piece = &whiteQueen;
-          break;
-        case 'q':
-          piece = &blackQueen;
-          break;
-        case 'P':
-          for (int i = 0; i < 8; ++i) {
-            if (whitePawns[i].getFile() == fromFile) {
-              piece = &whitePawns[i];
-              break;
-            }
-          }
-          break;
-        case 'p':
-          for (int i = 0; i < 8; i++) {
-            if (blackPawns[i].getFile() == fromFile) {
-              piece = &blackPawns[i];
-              break;
-            }
-          }
-          break;
-        case 'R':
-          for (int i = 0; i < 2; ++i) {
-            if (whiteRooks[i].getFile() == fromFile) {
-              piece = &whiteRooks[i];
-              break;
-            }
-          }
-          break;
-        case 'r':
-          for (int i = 0; i < 2; ++i) {
-            if (blackRooks[i].getFile() == fromFile) {
-              piece = &blackRooks[i];
-              break;
-            }
-          }
-          break;
-        case 'B':
-          for (int i = 0; i < 2; ++i) {
-            if (whiteBishops[i].getFile() == fromFile) {
-              piece = &whiteBishops[i];
-              break;
-            }
-          }
-          break;
-        case 'b':
-          for (int i = 0; i < 2; ++i) {
-            if (blackBishops[i].getFile() == fromFile) {
-              piece = &blackBishops[i];
-              break;
-            }
-          }
-          break;
-        case 'N':
-          for (int i = 0; i < 2; ++i) {
-            if (whiteKnights[i].getFile() == fromFile) {
-              piece = &whiteKnights[i];
-              break;
-            }
-          }
-          break;
-        case 'n':
-          for (int i = 0; i < 2; ++i) {
-            if (blackKnights[i].getFile() == fromFile) {
-              piece = &blackKnights[i];
-              break;
-            }
-          }
-          break;
-      }
-
-      if (input.size() >= 7 && input[5] == '=') {
-        char promotionPiece = input[6];
-        if ((whitesTurn && input[4] != '8') || (!whitesTurn && input[4] != '1')) {
-          std::cout << "invalid\n";
-          continue;
-        }
-        if ((whitesTurn && toRank == 0) || (!whitesTurn && toRank == 7)) {
-          if (piece && isValidPiece(SchachBrett[fromRank][fromFile]) && isValidPromotionPiece(promotionPiece)) {
-            dynamic_cast<Pawn*>(piece)->setPromotionPieceType(promotionPiece);
-            SchachBrett[toRank][toFile] = promotionPiece;
-            SchachBrett[fromRank][fromFile] = ' ';
-            if (InCheck(whiteKing, SchachBrett) || InCheck(blackKing, SchachBrett)) {
-              std::cout << "yes\n";
-            }
-            if (!InCheck(whiteKing, SchachBrett) && !InCheck(blackKing, SchachBrett)) {
-              std::cout << "no\n";
-            }
-          } else {
-            std::cout << "invalid\n";
-          }
-        }
-      }
-
-      if (input.size() >= 7 && input[6] == '=' && input[3] == 'x') {
-        char promotionPiece = input[7];
-        if (piece && isValidPiece(SchachBrett[fromRank][fromFile])) {
-          if ((whitesTurn && toRank == 0) || (!whitesTurn && toRank == 7)) {
-            if (isCaptureMove(toRank, toFile)) {
-            }
-            if (piece && isValidPromotionPiece(promotionPiece)) {
-              dynamic_cast<Pawn*>(piece)->setPromotionPieceType(promotionPiece);
-              SchachBrett[toRank][toFile] = promotionPiece;
-              SchachBrett[fromRank][fromFile] = ' ';
-              if (InCheck(whiteKing, SchachBrett) || InCheck(blackKing, SchachBrett)) {
-                std::cout << "yes\n";
-              }
-              if (!InCheck(whiteKing, SchachBrett) && !InCheck(blackKing, SchachBrett)) {
-                std::cout << "no"
-                          << "\n";
-              }
-            }
-          } else {
-            std::cout << "invalid\n";
-          }
-        }
-      }
-
-      if (input.size() < 7) {
-        if (piece && !isValidMove(*piece, toRank, toFile, SchachBrett)) {
-          std::cout << "invalid"
-                    << "1"
-                    << "\n";
-          continue;
-        }
-
-        
-        if (input[3] != 'x' && SchachBrett[toRank][toFile] != ' ') {
-            std::cout << "invalid"
-                      << "5"
-                      << "\n";
-            continue;
-          }
-
-        if (piece && isValidMove(*piece, toRank, toFile, SchachBrett)) {
-          piece->currentRank = toRank;
-          piece->currentFile = toFile;
-        }
-
-        previousBoards.push({SchachBrett, whitesTurn});
-
-        SchachBrett[toRank][toFile] = SchachBrett[fromRank][fromFile];
-        SchachBrett[fromRank][fromFile] = ' ';
-
-        if (piece) {
-          piece->currentRank = toRank;
-          piece->currentFile = toFile;
-        }
-
-        if (input[3] == 'x') {
-          if (SchachBrett[toRank][toFile] == ' ') {
-          std::cout << "invalid"
-                    << "7"
-                    << "\n";
-          continue;
-        }
-          if (isSameColor(SchachBrett[fromRank][fromFile], SchachBrett[toRank][toFile])) {
-            std::cout << "invalid"
-                      << "2"
-                      << "\n";
-            continue;
-          }
-          if (SchachBrett[toRank][toFile] == ' ') {
-            std::cout << "invalid"
-                      << "17"
-                      << "\n";
-            continue;
-          } 
-        }
-
-        if (InCheck(whiteKing, SchachBrett) || InCheck(blackKing, SchachBrett)) {
-          std::cout << "yes\n";
-        }
-        if (!InCheck(whiteKing, SchachBrett) && !InCheck(blackKing, SchachBrett)) {
-          std::cout << "no" << /*": tofile " << toFile << " toRank " << toRank <<*/ "\n";
-        }
-      }
-      switchTurn();
-    }
+  while (inputFile.next(input)) {
+    session.execute(input, output.buffer());
+    // A printed board goes out right away rather than when the block fills.
     if (input == "print") {
-      for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-          std::cout << SchachBrett[i][j];
-        }
-        std::cout << '\n';
-      }
-      continue;
+      output.push();
+    } else {
+      output.commit();
     }
   }
 
+  output.flush();
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,283 @@
+// Microbenchmarks for the rules hot paths, one JSON object per function and corpus on stdout.
+// Build: the microbench target of CMakeLists.txt.
+// Usage: microbench [--min-time SECONDS]
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "chess.h"
+
+// Every heap allocation made by the process; the benchmarks are single-threaded.
+std::size_t Allocations = 0;
+
+void* operator new(std::size_t size) {
+  ++Allocations;
+  if (void* memory = std::malloc(size ? size : 1)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+
+struct CorpusSource {
+  const char* name;
+  std::vector<const char*> fens;
+};
+
+// Each corpus is these positions and every position one legal move away from them.
+const std::vector<CorpusSource> CorpusSources = {
+    {"opening",
+     {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      "r1bqkbnr/pppp1ppp/2n5/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R b KQkq - 3 3",
+      "rnbqkb1r/pp2pppp/3p1n2/8/3NP3/8/PPP2PPP/RNBQKB1R w KQkq - 1 5",
+      "rnbqkb1r/ppp2ppp/4pn2/3p4/2PP4/2N5/PP2PPPP/R1BQKBNR w KQkq - 2 4"}},
+    {"middlegame",
+     {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+      "r2q1rk1/pp2bppp/2n1pn2/3p4/3P4/2NBPN2/PP3PPP/R2Q1RK1 b - - 3 10",
+      "2rq1rk1/pb1nbppp/1p2pn2/2pp4/2PP4/1PN1PN2/PB2BPPP/2RQ1RK1 w - - 4 11"}},
+    {"endgame",
+     {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", "8/8/1p3k2/p1p5/P1P1r3/1P3R2/5KP1/8 w - - 0 1",
+      "8/5k2/8/3P4/8/8/5K2/8 w - - 0 1", "8/8/4k3/8/2B5/3NK3/8/8 b - - 0 1"}},
+    {"promotion",
+     {"n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1", "8/P1P1P1P1/8/8/8/8/1p1p1p1p/K6k w - - 0 1",
+      "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"}},
+};
+
+struct Sample {
+  ChessBoard board;
+  Color side;
+};
+
+struct Corpus {
+  const char* name;
+  std::vector<Sample> positions;
+  // M line bodies of every legal move in every position.
+  std::vector<std::string> moveTexts;
+  // The 64 squares of every position, as a B line carries them.
+  std::vector<std::string> boardTexts;
+};
+
+Corpus buildCorpus(const CorpusSource& source) {
+  Corpus corpus{source.name, {}, {}, {}};
+  for (const char* fen : source.fens) {
+    Sample root;
+    if (!loadFen(fen, root.board, root.side)) {
+      std::cerr << "bad corpus FEN: " << fen << '\n';
+      std::exit(EXIT_FAILURE);
+    }
+    corpus.positions.push_back(root);
+    MoveList moves;
+    generateLegalMoves(root.board, root.side, moves);
+    for (Move move : moves) {
+      Sample child = root;
+      makeMove(child.board, move);
+      child.side = opposite(root.side);
+      corpus.positions.push_back(child);
+    }
+  }
+  for (const Sample& sample : corpus.positions) {
+    MoveList moves;
+    generateLegalMoves(sample.board, sample.side, moves);
+    for (Move move : moves) {
+      corpus.moveTexts.push_back(moveToText(sample.board, move));
+    }
+    std::string squares;
+    for (const ChessBoard::Rank& rank : sample.board.squares) {
+      squares.append(rank.data(), rank.size());
+    }
+    corpus.boardTexts.push_back(squares);
+  }
+  return corpus;
+}
+
+// Keeps results alive so the compiler cannot drop the work that produced them.
+volatile std::uint64_t Sink = 0;
+
+// Writes the JSON array, one element per measure() call.
+struct BenchRun {
+  double minSeconds;
+  bool first = true;
+
+  // Repeats `pass` (one run over the corpus, `opsPerPass` calls) until `minSeconds` have gone by.
+  template <typename Pass>
+  void measure(const char* function, const char* corpus, std::size_t opsPerPass, Pass pass);
+};
+
+template <typename Pass>
+void BenchRun::measure(const char* function, const char* corpus, std::size_t opsPerPass, Pass pass) {
+  if (opsPerPass == 0) {
+    return;
+  }
+  Sink = Sink + pass();
+  std::uint64_t passes = 0;
+  std::uint64_t checksum = 0;
+  const std::size_t allocationsBefore = Allocations;
+  const auto start = std::chrono::steady_clock::now();
+  double seconds = 0;
+  do {
+    checksum += pass();
+    ++passes;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (seconds < minSeconds);
+  const std::size_t allocations = Allocations - allocationsBefore;
+  Sink = Sink + checksum;
+
+  const double ops = static_cast<double>(passes) * opsPerPass;
+  std::cout << (first ? "  " : ",\n  ") << "{\"function\": \"" << function << "\", \"corpus\": \"" << corpus
+            << "\", \"ops\": " << static_cast<std::uint64_t>(ops) << ", \"ns_per_op\": " << seconds * 1e9 / ops
+            << ", \"ops_per_sec\": " << ops / seconds << ", \"allocs_per_op\": " << allocations / ops << "}";
+  first = false;
+}
+
+std::unique_ptr<ChessPiece> makePiece(char piece, int square) {
+  const bool white = isupper(piece);
+  const int rank = square / 8;
+  const int file = square % 8;
+  switch (static_cast<PieceKind>(pieceIndex(piece) % 6)) {
+    case PieceKind::Pawn: return std::make_unique<Pawn>(white, rank, file);
+    case PieceKind::Knight: return std::make_unique<Knight>(white, rank, file);
+    case PieceKind::Bishop: return std::make_unique<Bishop>(white, rank, file);
+    case PieceKind::Rook: return std::make_unique<Rook>(white, rank, file);
+    case PieceKind::Queen: return std::make_unique<Queen>(white, rank, file);
+    case PieceKind::King: return std::make_unique<King>(white, rank, file);
+  }
+  return nullptr;
+}
+
+// One piece of the side to move, asked about all 64 target squares.
+struct PieceSample {
+  std::unique_ptr<ChessPiece> piece;
+  const ChessBoard* board;
+};
+
+void benchCorpus(const Corpus& corpus, BenchRun& run) {
+  std::vector<PieceSample> kings;
+  std::array<std::vector<PieceSample>, 6> pieces;
+  for (const Sample& sample : corpus.positions) {
+    for (Bitboard own = sample.board.colorMask(sample.side); own;) {
+      const int square = popLowestSquare(own);
+      const char piece = sample.board.at(square);
+      pieces[pieceIndex(piece) % 6].push_back({makePiece(piece, square), &sample.board});
+      if (pieceIndex(piece) % 6 == static_cast<int>(PieceKind::King)) {
+        kings.push_back({makePiece(piece, square), &sample.board});
+      }
+    }
+  }
+
+  run.measure("InCheck", corpus.name, kings.size(), [&] {
+    std::uint64_t checks = 0;
+    for (const PieceSample& king : kings) {
+      checks += InCheck(*king.piece, *king.board);
+    }
+    return checks;
+  });
+
+  constexpr std::array<const char*, 6> validators = {"Pawn::isValidMove", "Knight::isValidMove",
+                                                     "Bishop::isValidMove", "Rook::isValidMove",
+                                                     "Queen::isValidMove", "King::isValidMove"};
+  for (int kind = 0; kind < 6; ++kind) {
+    run.measure(validators[kind], corpus.name, 64 * pieces[kind].size(), [&] {
+      std::uint64_t valid = 0;
+      for (const PieceSample& sample : pieces[kind]) {
+        for (int to = 0; to < 64; ++to) {
+          valid += sample.piece->isValidMove(to / 8, to % 8, *sample.board);
+        }
+      }
+      return valid;
+    });
+  }
+
+  // Both kings of every position, one position at a time and then across positions.
+  run.measure("isInCheck", corpus.name, corpus.positions.size(), [&] {
+    std::uint64_t checks = 0;
+    for (const Sample& sample : corpus.positions) {
+      checks += isInCheck(Color::White, sample.board) + 2 * isInCheck(Color::Black, sample.board);
+    }
+    return checks;
+  });
+
+  PositionBatch batch;
+  for (const Sample& sample : corpus.positions) {
+    batch.add(sample.board);
+  }
+  std::vector<std::uint8_t> results(batch.size());
+  run.measure("batchCheckStatus", corpus.name, batch.size(), [&] {
+    batchCheckStatus(batch, results.data());
+    std::uint64_t checks = 0;
+    for (std::uint8_t result : results) {
+      checks += result;
+    }
+    return checks;
+  });
+
+  run.measure("convertInput", corpus.name, corpus.moveTexts.size(), [&] {
+    std::uint64_t squares = 0;
+    for (const std::string& text : corpus.moveTexts) {
+      int fromRank, fromFile, toRank, toFile;
+      convertInput(text, isupper(text[0]) ? Color::White : Color::Black, fromRank, fromFile, toRank, toFile);
+      squares += fromRank + fromFile + toRank + toFile;
+    }
+    return squares;
+  });
+
+  // The B-line loader on its own: validating the 64 chars, then decoding them into a board. Position::loadBoard
+  // adds the attack map rebuild and the check verdict, which the benchmarks above already cover.
+  run.measure("isValidBoardString", corpus.name, corpus.boardTexts.size(), [&] {
+    std::uint64_t valid = 0;
+    for (const std::string& text : corpus.boardTexts) {
+      valid += isValidBoardString(text);
+    }
+    return valid;
+  });
+
+  ChessBoard loaded;
+  run.measure("ChessBoard::loadSquares", corpus.name, corpus.boardTexts.size(), [&] {
+    std::uint64_t keys = 0;
+    for (const std::string& text : corpus.boardTexts) {
+      loaded.loadSquares(text.data());
+      keys ^= loaded.key;
+    }
+    return keys;
+  });
+}
+
+int main(int argc, char* argv[]) {
+  double minSeconds = 0.2;
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+    if (argument == "--min-time" && i + 1 < argc) {
+      minSeconds = std::atof(argv[++i]);
+    } else {
+      std::cerr << "usage: microbench [--min-time SECONDS]\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<Corpus> corpora;
+  for (const CorpusSource& source : CorpusSources) {
+    corpora.push_back(buildCorpus(source));
+  }
+
+  BenchRun run{minSeconds};
+  std::cout << "[\n";
+  for (const Corpus& corpus : corpora) {
+    benchCorpus(corpus, run);
+  }
+  std::cout << "\n]\n";
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+#include "output.h"
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+
+#include "stats.h"
+
+OutputWriter::OutputWriter(int fd) : fd(fd), writer(&OutputWriter::run, this) { current.reserve(BlockBytes * 2); }
+
+OutputWriter::~OutputWriter() {
+  flush();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  writer.join();
+}
+
+void OutputWriter::write(std::string&& block) {
+  push();
+  if (!block.empty()) {
+    enqueue(std::move(block));
+  }
+}
+
+void OutputWriter::flush() {
+  push();
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [&] { return queue.empty() && !writing; });
+}
+
+void OutputWriter::submit() {
+  enqueue(std::move(current));
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!spare.empty()) {
+    current = std::move(spare.back());
+    spare.pop_back();
+  } else {
+    current = std::string();
+    current.reserve(BlockBytes * 2);
+  }
+}
+
+void OutputWriter::enqueue(std::string&& block) {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&] { return queue.size() < MaxQueuedBlocks; });
+    queue.push_back(std::move(block));
+  }
+  changed.notify_all();
+}
+
+// Writes all of `blocks`, resuming after partial writes; on an error the rest is dropped.
+void writeBlocks(int fd, std::vector<std::string>& blocks) {
+  const StageTimer timer(Stage::Output);
+  std::vector<iovec> pieces;
+  for (std::string& block : blocks) {
+    pieces.push_back(iovec{block.data(), block.size()});
+  }
+  std::size_t first = 0;
+  while (first < pieces.size()) {
+    const int count = static_cast<int>(std::min<std::size_t>(pieces.size() - first, IOV_MAX));
+    const ssize_t written = writev(fd, pieces.data() + first, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    for (std::size_t left = written; left > 0;) {
+      const std::size_t step = std::min(left, pieces[first].iov_len);
+      pieces[first].iov_base = static_cast<char*>(pieces[first].iov_base) + step;
+      pieces[first].iov_len -= step;
+      left -= step;
+      if (pieces[first].iov_len == 0) {
+        ++first;
+      }
+    }
+    while (first < pieces.size() && pieces[first].iov_len == 0) {
+      ++first;
+    }
+  }
+}
+
+void OutputWriter::run() {
+  std::vector<std::string> blocks;
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    changed.wait(lock, [&] { return !queue.empty() || stopping; });
+    if (queue.empty()) {
+      return;
+    }
+    while (!queue.empty()) {
+      blocks.push_back(std::move(queue.front()));
+      queue.pop_front();
+    }
+    writing = true;
+    lock.unlock();
+    changed.notify_all();
+
+    writeBlocks(fd, blocks);
+
+    lock.lock();
+    for (std::string& block : blocks) {
+      if (spare.size() < MaxQueuedBlocks) {
+        block.clear();
+        spare.push_back(std::move(block));
+      }
+    }
+    blocks.clear();
+    writing = false;
+    changed.notify_all();
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Output stage: text is collected into large blocks that a writer thread hands to the kernel with
+// writev(), so producing output costs an append and writing it never holds up the caller. One
+// producer at a time; the destructor flushes whatever is left.
+class OutputWriter {
+ public:
+  static constexpr std::size_t BlockBytes = std::size_t{1} << 16;
+  // Full blocks the producer may run ahead of the writer before it has to wait.
+  static constexpr std::size_t MaxQueuedBlocks = 64;
+
+  explicit OutputWriter(int fd);
+  ~OutputWriter();
+  OutputWriter(const OutputWriter&) = delete;
+  OutputWriter& operator=(const OutputWriter&) = delete;
+
+  // The block being filled. Append to it directly, then commit().
+  std::string& buffer() { return current; }
+
+  // Queues the block for writing once it is full.
+  void commit() {
+    if (current.size() >= BlockBytes) {
+      submit();
+    }
+  }
+
+  void write(std::string_view text) {
+    current.append(text);
+    commit();
+  }
+
+  // Queues an already assembled block as it is, without copying it.
+  void write(std::string&& block);
+
+  // Hands what has been collected to the writer thread now, without waiting for it to be written.
+  void push() {
+    if (!current.empty()) {
+      submit();
+    }
+  }
+
+  // Returns once everything written so far has reached the file descriptor.
+  void flush();
+
+ private:
+  void submit();
+  void enqueue(std::string&& block);
+  void run();
+
+  int fd;
+  std::string current;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::string> queue;
+  // Emptied blocks, handed back to the producer so steady-state output allocates nothing.
+  std::vector<std::string> spare;
+  bool writing = false;
+  bool stopping = false;
+  std::thread writer;
+};
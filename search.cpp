@@ -0,0 +1,552 @@
+#include "search.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+using SearchClock = std::chrono::steady_clock;
+
+// Plies from the root, quiescence included; a line reaching the last one is scored by evaluate().
+constexpr int MaxPly = 128;
+constexpr int Infinity = MateScore + 1;
+// Scores beyond this are mates.
+constexpr int MateBound = MateScore - MaxPly;
+
+enum class Bound : std::uint8_t { Exact, Lower, Upper };
+
+// Position key -> best move, score and depth, shared by all search threads without locks. Like PerftHash, a slot
+// stores its data and the key XOR the data, so a slot torn by two racing writers reads as a miss.
+class TranspositionTable {
+ public:
+  struct Entry {
+    Move move = 0;
+    int score = 0;
+    int depth = 0;
+    Bound bound = Bound::Exact;
+  };
+
+  explicit TranspositionTable(std::size_t megabytes) {
+    std::size_t size = 1;
+    while (size * 2 * sizeof(Slot) <= megabytes << 20) {
+      size *= 2;
+    }
+    slots = std::make_unique<Slot[]>(size);
+    mask = size - 1;
+  }
+
+  bool probe(std::uint64_t key, Entry& entry) const {
+    const Slot& slot = slots[key & mask];
+    const std::uint64_t data = slot.data.load(std::memory_order_relaxed);
+    if ((slot.check.load(std::memory_order_relaxed) ^ data) != key) {
+      return false;
+    }
+    entry.move = static_cast<Move>(data);
+    entry.score = static_cast<int>((data >> 16) & 0xFFFF) - 0x8000;
+    entry.depth = static_cast<int>((data >> 32) & 0xFF);
+    entry.bound = static_cast<Bound>((data >> 40) & 3);
+    return true;
+  }
+
+  void store(std::uint64_t key, const Entry& entry) {
+    const std::uint64_t data = entry.move | static_cast<std::uint64_t>(entry.score + 0x8000) << 16 |
+                               static_cast<std::uint64_t>(entry.depth) << 32 |
+                               static_cast<std::uint64_t>(entry.bound) << 40;
+    Slot& slot = slots[key & mask];
+    slot.check.store(key ^ data, std::memory_order_relaxed);
+    slot.data.store(data, std::memory_order_relaxed);
+  }
+
+ private:
+  struct Slot {
+    std::atomic<std::uint64_t> check{0};
+    std::atomic<std::uint64_t> data{0};
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  std::size_t mask = 0;
+};
+
+// Mate scores are stored relative to the node rather than the root, so they stay right wherever the entry is hit.
+int scoreToTable(int score, int ply) {
+  return score >= MateBound ? score + ply : score <= -MateBound ? score - ply : score;
+}
+
+int scoreFromTable(int score, int ply) {
+  return score >= MateBound ? score - ply : score <= -MateBound ? score + ply : score;
+}
+
+// Per PieceKind.
+constexpr std::array<int, 6> PieceValues = {100, 320, 330, 500, 900, 0};
+
+// Bonus per PieceKind and square for a white piece, a8 first; a black piece reads the square mirrored (^ 56).
+using SquareTable = std::array<int, 64>;
+
+constexpr std::array<SquareTable, 6> PieceSquareTables = {{
+    {
+          0,   0,   0,   0,   0,   0,   0,   0,
+         50,  50,  50,  50,  50,  50,  50,  50,
+         10,  10,  20,  30,  30,  20,  10,  10,
+          5,   5,  10,  25,  25,  10,   5,   5,
+          0,   0,   0,  20,  20,   0,   0,   0,
+          5,  -5, -10,   0,   0, -10,  -5,   5,
+          5,  10,  10, -20, -20,  10,  10,   5,
+          0,   0,   0,   0,   0,   0,   0,   0,
+    },
+    {
+        -50, -40, -30, -30, -30, -30, -40, -50,
+        -40, -20,   0,   0,   0,   0, -20, -40,
+        -30,   0,  10,  15,  15,  10,   0, -30,
+        -30,   5,  15,  20,  20,  15,   5, -30,
+        -30,   0,  15,  20,  20,  15,   0, -30,
+        -30,   5,  10,  15,  15,  10,   5, -30,
+        -40, -20,   0,   5,   5,   0, -20, -40,
+        -50, -40, -30, -30, -30, -30, -40, -50,
+    },
+    {
+        -20, -10, -10, -10, -10, -10, -10, -20,
+        -10,   0,   0,   0,   0,   0,   0, -10,
+        -10,   0,   5,  10,  10,   5,   0, -10,
+        -10,   5,   5,  10,  10,   5,   5, -10,
+        -10,   0,  10,  10,  10,  10,   0, -10,
+        -10,  10,  10,  10,  10,  10,  10, -10,
+        -10,   5,   0,   0,   0,   0,   5, -10,
+        -20, -10, -10, -10, -10, -10, -10, -20,
+    },
+    {
+          0,   0,   0,   0,   0,   0,   0,   0,
+          5,  10,  10,  10,  10,  10,  10,   5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+          0,   0,   0,   5,   5,   0,   0,   0,
+    },
+    {
+        -20, -10, -10,  -5,  -5, -10, -10, -20,
+        -10,   0,   0,   0,   0,   0,   0, -10,
+        -10,   0,   5,   5,   5,   5,   0, -10,
+         -5,   0,   5,   5,   5,   5,   0,  -5,
+          0,   0,   5,   5,   5,   5,   0,  -5,
+        -10,   5,   5,   5,   5,   5,   0, -10,
+        -10,   0,   5,   0,   0,   0,   0, -10,
+        -20, -10, -10,  -5,  -5, -10, -10, -20,
+    },
+    {
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -20, -30, -30, -40, -40, -30, -30, -20,
+        -10, -20, -20, -20, -20, -20, -20, -10,
+         20,  20,   0,   0,   0,   0,  20,  20,
+         20,  30,  10,   0,   0,  10,  30,  20,
+    },
+}};
+
+// The king walks to the centre once the pieces are off; evaluate() blends the two king tables by what is left.
+constexpr SquareTable EndgameKingTable = {
+    -50, -40, -30, -20, -20, -30, -40, -50,
+    -30, -20, -10,   0,   0, -10, -20, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -30,   0,   0,   0,   0, -30, -30,
+    -50, -30, -30, -30, -30, -30, -30, -50,
+};
+
+// Knights and bishops 1, rooks 2, queens 4: 24 with all of them on the board.
+constexpr std::array<int, 6> PhaseWeights = {0, 1, 1, 2, 4, 0};
+constexpr int OpeningPhase = 24;
+
+// Material and piece-square bonuses, in centipawns for the side to move.
+int evaluate(const ChessBoard& board, Color side) {
+  int phase = 0;
+  for (int kind = 0; kind < 6; ++kind) {
+    phase += PhaseWeights[kind] * __builtin_popcountll(board.kindMask(static_cast<PieceKind>(kind)));
+  }
+  phase = std::min(phase, OpeningPhase);
+
+  int score = 0;
+  for (int slot = 0; slot < 12; ++slot) {
+    const int kind = slot % 6;
+    const int sign = slot < 6 ? 1 : -1;
+    for (Bitboard pieces = board.pieces[slot]; pieces;) {
+      const int square = popLowestSquare(pieces) ^ (slot < 6 ? 0 : 56);
+      int bonus = PieceSquareTables[kind][square];
+      if (kind == static_cast<int>(PieceKind::King)) {
+        bonus = (bonus * phase + EndgameKingTable[square] * (OpeningPhase - phase)) / OpeningPhase;
+      }
+      score += sign * (PieceValues[kind] + bonus);
+    }
+  }
+  return side == Color::White ? score : -score;
+}
+
+// What the threads of one search share besides the table.
+struct SharedSearch {
+  explicit SharedSearch(TranspositionTable& table) : table(table) {}
+
+  TranspositionTable& table;
+  std::atomic<bool> stop{false};
+  bool timed = false;
+  SearchClock::time_point deadline;
+};
+
+// Ordering: the table move, captures by MVV-LVA, queen promotions, the two killers, then the history score.
+constexpr int TableMoveOrder = 1 << 30;
+constexpr int CaptureOrder = 1 << 24;
+constexpr int PromotionOrder = 1 << 23;
+constexpr int KillerOrder = 1 << 22;
+constexpr int HistoryLimit = 1 << 21;
+
+// One thread's search over its own copy of the board.
+class SearchWorker {
+ public:
+  SearchWorker(SharedSearch& shared, const ChessBoard& board, Color side, bool isMain)
+      : shared(shared), board(board), side(side), isMain(isMain) {}
+
+  // One full-width iteration from the root; the score is meaningless if `shared.stop` was set meanwhile.
+  int searchDepth(int depth) {
+    mayStop = depth > 1;
+    return alphaBeta(depth, 0, -Infinity, Infinity);
+  }
+
+  std::vector<Move> principalVariation() const {
+    return std::vector<Move>(pv[0].begin(), pv[0].begin() + pvLength[0]);
+  }
+  std::uint64_t getNodes() const { return nodes.load(std::memory_order_relaxed); }
+
+ private:
+  // Counts the node and tells whether the search is to be abandoned. Only the main thread watches the clock.
+  bool enterNode() {
+    const std::uint64_t count = nodes.load(std::memory_order_relaxed) + 1;
+    nodes.store(count, std::memory_order_relaxed);
+    if (isMain && mayStop && shared.timed && (count & 1023) == 0 && SearchClock::now() >= shared.deadline) {
+      shared.stop.store(true, std::memory_order_relaxed);
+    }
+    return shared.stop.load(std::memory_order_relaxed) && mayStop;
+  }
+
+  bool isRepetition(std::uint64_t key, int ply) const {
+    for (int earlier = ply - 4; earlier >= 0; earlier -= 2) {
+      if (keys[earlier] == key) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int orderOf(Move move, Move tableMove, int ply) const {
+    if (move == tableMove) {
+      return TableMoveOrder;
+    }
+    if (isCapture(move)) {
+      const int victim = board.slotAt(moveTo(move));
+      const int victimKind = victim == EmptySlot ? static_cast<int>(PieceKind::Pawn) : victim % 6;
+      return CaptureOrder + 8 * victimKind - board.slotAt(moveFrom(move)) % 6;
+    }
+    if (movePromotion(move) == PieceKind::Queen) {
+      return PromotionOrder;
+    }
+    if (move == killers[ply][0]) {
+      return KillerOrder + 1;
+    }
+    if (move == killers[ply][1]) {
+      return KillerOrder;
+    }
+    return history[static_cast<int>(side)][moveFrom(move)][moveTo(move)];
+  }
+
+  // Moves the best-ordered of the moves from `index` on to `index`.
+  static void pickMove(MoveList& moves, std::array<int, MoveList::Capacity>& orders, int index) {
+    int best = index;
+    for (int other = index + 1; other < moves.size(); ++other) {
+      if (orders[other] > orders[best]) {
+        best = other;
+      }
+    }
+    std::swap(moves.moves[index], moves.moves[best]);
+    std::swap(orders[index], orders[best]);
+  }
+
+  void makeSearchMove(Move move, MoveRecord& record) {
+    record = makeMove(board, move);
+    side = opposite(side);
+  }
+
+  void unmakeSearchMove(const MoveRecord& record) {
+    unmakeMove(board, record);
+    side = opposite(side);
+  }
+
+  void updatePv(int ply, Move move) {
+    pv[ply][ply] = move;
+    std::copy(pv[ply + 1].begin() + ply + 1, pv[ply + 1].begin() + pvLength[ply + 1], pv[ply].begin() + ply + 1);
+    pvLength[ply] = std::max(pvLength[ply + 1], ply + 1);
+  }
+
+  int alphaBeta(int depth, int ply, int alpha, int beta) {
+    pvLength[ply] = ply;
+    if (depth <= 0) {
+      return quiesce(ply, alpha, beta);
+    }
+    if (enterNode()) {
+      return 0;
+    }
+    const std::uint64_t key = positionKey(board, side);
+    keys[ply] = key;
+    if (ply > 0 && isRepetition(key, ply)) {
+      return 0;
+    }
+    if (ply >= MaxPly - 1) {
+      return evaluate(board, side);
+    }
+
+    const bool pvNode = beta - alpha > 1;
+    TranspositionTable::Entry entry;
+    Move tableMove = 0;
+    if (shared.table.probe(key, entry)) {
+      tableMove = entry.move;
+      const int score = scoreFromTable(entry.score, ply);
+      if (!pvNode && ply > 0 && entry.depth >= depth &&
+          (entry.bound == Bound::Exact || (entry.bound == Bound::Lower && score >= beta) ||
+           (entry.bound == Bound::Upper && score <= alpha))) {
+        return score;
+      }
+    }
+
+    MoveList moves;
+    generateLegalMoves(board, side, moves);
+    const bool inCheck = isInCheck(side, board);
+    if (moves.size() == 0) {
+      return inCheck ? -MateScore + ply : 0;
+    }
+    if (inCheck) {
+      ++depth;
+    }
+
+    std::array<int, MoveList::Capacity> orders;
+    for (int index = 0; index < moves.size(); ++index) {
+      orders[index] = orderOf(moves.moves[index], tableMove, ply);
+    }
+
+    const int originalAlpha = alpha;
+    int best = -Infinity;
+    Move bestMove = 0;
+    for (int index = 0; index < moves.size(); ++index) {
+      pickMove(moves, orders, index);
+      const Move move = moves.moves[index];
+      MoveRecord record;
+      makeSearchMove(move, record);
+      // Principal variation search: later moves only have to be shown no better, unless they turn out to be.
+      int score;
+      if (index == 0) {
+        score = -alphaBeta(depth - 1, ply + 1, -beta, -alpha);
+      } else {
+        score = -alphaBeta(depth - 1, ply + 1, -alpha - 1, -alpha);
+        if (score > alpha && score < beta) {
+          score = -alphaBeta(depth - 1, ply + 1, -beta, -alpha);
+        }
+      }
+      unmakeSearchMove(record);
+      if (shared.stop.load(std::memory_order_relaxed) && mayStop) {
+        return 0;
+      }
+
+      if (score > best) {
+        best = score;
+        bestMove = move;
+        if (score > alpha) {
+          alpha = score;
+          updatePv(ply, move);
+        }
+      }
+      if (alpha >= beta) {
+        if (!isCapture(move)) {
+          if (killers[ply][0] != move) {
+            killers[ply][1] = killers[ply][0];
+            killers[ply][0] = move;
+          }
+          int& score = history[static_cast<int>(side)][moveFrom(move)][moveTo(move)];
+          score = std::min(score + depth * depth, HistoryLimit);
+        }
+        break;
+      }
+    }
+
+    const Bound bound = best >= beta ? Bound::Lower : best > originalAlpha ? Bound::Exact : Bound::Upper;
+    shared.table.store(key, {bestMove, scoreToTable(best, ply), depth, bound});
+    return best;
+  }
+
+  // Captures and queen promotions until the position is quiet; every move when in check.
+  int quiesce(int ply, int alpha, int beta) {
+    pvLength[ply] = ply;
+    if (enterNode()) {
+      return 0;
+    }
+    if (ply >= MaxPly - 1) {
+      return evaluate(board, side);
+    }
+    const bool inCheck = isInCheck(side, board);
+    int best = -Infinity;
+    if (!inCheck) {
+      best = evaluate(board, side);
+      if (best >= beta) {
+        return best;
+      }
+      alpha = std::max(alpha, best);
+    }
+
+    MoveList moves;
+    generateLegalMoves(board, side, moves);
+    if (inCheck && moves.size() == 0) {
+      return -MateScore + ply;
+    }
+    std::array<int, MoveList::Capacity> orders;
+    for (int index = 0; index < moves.size(); ++index) {
+      const Move move = moves.moves[index];
+      orders[index] = inCheck || isCapture(move) || movePromotion(move) == PieceKind::Queen ? orderOf(move, 0, ply)
+                                                                                             : -1;
+    }
+
+    for (int index = 0; index < moves.size(); ++index) {
+      pickMove(moves, orders, index);
+      if (orders[index] < 0) {
+        break;
+      }
+      const Move move = moves.moves[index];
+      MoveRecord record;
+      makeSearchMove(move, record);
+      const int score = -quiesce(ply + 1, -beta, -alpha);
+      unmakeSearchMove(record);
+      if (shared.stop.load(std::memory_order_relaxed) && mayStop) {
+        return 0;
+      }
+      if (score > best) {
+        best = score;
+        if (score > alpha) {
+          alpha = score;
+          updatePv(ply, move);
+        }
+      }
+      if (alpha >= beta) {
+        break;
+      }
+    }
+    return best;
+  }
+
+  SharedSearch& shared;
+  ChessBoard board;
+  Color side;
+  bool isMain;
+  // The first iteration always completes, so there is a move to report however short the time.
+  bool mayStop = false;
+  std::atomic<std::uint64_t> nodes{0};
+  std::array<std::uint64_t, MaxPly> keys{};
+  std::array<std::array<Move, 2>, MaxPly> killers{};
+  // Per Color, from and to square: how often the quiet move caused a cutoff, weighted by depth squared.
+  std::array<std::array<std::array<int, 64>, 64>, 2> history{};
+  // Triangular table: pv[ply] holds the best line found from `ply`, up to pvLength[ply].
+  std::array<std::array<Move, MaxPly>, MaxPly> pv;
+  std::array<int, MaxPly> pvLength{};
+};
+
+void appendScore(int score, std::string& out) {
+  if (std::abs(score) >= MateBound) {
+    const int moves = (MateScore - std::abs(score) + 1) / 2;
+    out += "mate ";
+    out += std::to_string(score > 0 ? moves : -moves);
+  } else {
+    out += "cp ";
+    out += std::to_string(score);
+  }
+}
+
+Searcher::Searcher(std::size_t hashMegabytes) : table(std::make_unique<TranspositionTable>(hashMegabytes)) {}
+
+Searcher::~Searcher() = default;
+
+SearchResult Searcher::search(const ChessBoard& board, Color side, const SearchLimits& limits, std::string& out) {
+  const SearchClock::time_point start = SearchClock::now();
+  SharedSearch shared(*table);
+  shared.timed = limits.movetime > 0;
+  shared.deadline = start + std::chrono::milliseconds(limits.movetime);
+  const int maxDepth = limits.depth > 0 ? std::min(limits.depth, MaxSearchDepth) : MaxSearchDepth;
+
+  std::vector<std::unique_ptr<SearchWorker>> workers;
+  for (int index = 0; index < std::max(1, limits.threads); ++index) {
+    workers.push_back(std::make_unique<SearchWorker>(shared, board, side, index == 0));
+  }
+  // Helpers run ahead of the main thread, half of them by one ply, filling the table with what it will need.
+  std::vector<std::thread> helpers;
+  for (std::size_t index = 1; index < workers.size(); ++index) {
+    helpers.emplace_back([&shared, &worker = *workers[index], index] {
+      for (int depth = 1 + index % 2; depth <= MaxSearchDepth && !shared.stop.load(std::memory_order_relaxed);
+           ++depth) {
+        worker.searchDepth(depth);
+      }
+    });
+  }
+
+  const auto countNodes = [&] {
+    std::uint64_t nodes = 0;
+    for (const std::unique_ptr<SearchWorker>& worker : workers) {
+      nodes += worker->getNodes();
+    }
+    return nodes;
+  };
+
+  SearchResult result;
+  SearchWorker& main = *workers[0];
+  for (int depth = 1; depth <= maxDepth; ++depth) {
+    const int score = main.searchDepth(depth);
+    if (shared.stop.load(std::memory_order_relaxed)) {
+      break;
+    }
+    result.depth = depth;
+    result.score = score;
+    result.pv = main.principalVariation();
+    result.bestMove = result.pv.empty() ? 0 : result.pv[0];
+
+    const double seconds = std::chrono::duration<double>(SearchClock::now() - start).count();
+    const std::uint64_t nodes = countNodes();
+    out += "info depth ";
+    out += std::to_string(depth);
+    out += " score ";
+    appendScore(score, out);
+    out += " nodes ";
+    out += std::to_string(nodes);
+    out += " nps ";
+    out += std::to_string(seconds > 0 ? static_cast<std::uint64_t>(nodes / seconds) : nodes);
+    out += " time ";
+    out += std::to_string(static_cast<std::uint64_t>(seconds * 1000));
+    out += " pv";
+    for (Move move : result.pv) {
+      out += ' ';
+      out += moveToString(move);
+    }
+    out += '\n';
+
+    // Nothing to choose from, a mate that no deeper search can change, or too little time for another iteration.
+    if (!result.bestMove || MateScore - std::abs(score) <= depth ||
+        (shared.timed && seconds * 2000 >= limits.movetime)) {
+      break;
+    }
+  }
+
+  shared.stop.store(true, std::memory_order_relaxed);
+  for (std::thread& helper : helpers) {
+    helper.join();
+  }
+  result.nodes = countNodes();
+  out += "bestmove ";
+  out += result.bestMove ? moveToString(result.bestMove) : "none";
+  out += '\n';
+  return result;
+}
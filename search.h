@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chess.h"
+
+constexpr int MaxSearchDepth = 64;
+// A mate found `ply` plies from the root scores MateScore - ply for the side giving it.
+constexpr int MateScore = 32000;
+
+struct SearchLimits {
+  // Either may be 0 for no limit; with neither the search runs to MaxSearchDepth.
+  int depth = 0;
+  std::uint64_t movetime = 0;
+  // Lazy SMP: every thread searches the whole tree, sharing only the transposition table.
+  int threads = 1;
+};
+
+struct SearchResult {
+  // 0 when the side to move has no legal move.
+  Move bestMove = 0;
+  // Centipawns for the side to move.
+  int score = 0;
+  int depth = 0;
+  std::uint64_t nodes = 0;
+  std::vector<Move> pv;
+};
+
+class TranspositionTable;
+
+// Iterative-deepening alpha-beta over the moves generateLegalMoves() gives, which come from the same
+// reachableSquares() rules the ChessPiece classes and the M path validate with. The transposition table
+// is kept from one search to the next.
+class Searcher {
+ public:
+  static constexpr std::size_t DefaultHashMegabytes = 16;
+
+  explicit Searcher(std::size_t hashMegabytes = DefaultHashMegabytes);
+  ~Searcher();
+  Searcher(const Searcher&) = delete;
+  Searcher& operator=(const Searcher&) = delete;
+
+  // Appends "info depth <d> score cp <s>|mate <m> nodes <n> nps <n> time <ms> pv <moves>" for every depth
+  // completed and then "bestmove <move>" ("bestmove none" without a legal move) to `out`.
+  SearchResult search(const ChessBoard& board, Color side, const SearchLimits& limits, std::string& out);
+
+ private:
+  std::unique_ptr<TranspositionTable> table;
+};
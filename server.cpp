@@ -0,0 +1,358 @@
+#include "server.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+SessionServer::SessionServer(std::string path, int workers, int threads, bool reportStatus)
+    : path(std::move(path)), workerCount(workers), threads(threads), reportStatus(reportStatus) {}
+
+SessionServer::~SessionServer() {
+  {
+    std::lock_guard<std::mutex> lock(readyMutex);
+    stopping = true;
+  }
+  readyChanged.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  for (const auto& connection : connections) {
+    ::close(connection.first);
+  }
+  for (int fd : {listenFd, epollFd, wakeFd}) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+  if (listenFd >= 0) {
+    unlink(path.c_str());
+  }
+}
+
+bool SessionServer::listen() {
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listenFd < 0) {
+    return false;
+  }
+  // A socket file left behind by an earlier run would make bind() fail.
+  unlink(path.c_str());
+  if (bind(listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 ||
+      ::listen(listenFd, SOMAXCONN) < 0) {
+    return false;
+  }
+
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epollFd < 0 || wakeFd < 0) {
+    return false;
+  }
+  for (int fd : {listenFd, wakeFd}) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SessionServer::run() {
+  if (!listen()) {
+    return false;
+  }
+  for (int index = 0; index < workerCount; ++index) {
+    workers.emplace_back(&SessionServer::work, this);
+  }
+
+  std::array<epoll_event, 64> events;
+  for (;;) {
+    const int count = epoll_wait(epollFd, events.data(), events.size(), -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    for (int index = 0; index < count; ++index) {
+      const int fd = events[index].data.fd;
+      if (fd == listenFd) {
+        acceptConnections();
+      } else if (fd == wakeFd) {
+        std::uint64_t wakeups;
+        while (read(wakeFd, &wakeups, sizeof(wakeups)) > 0) {
+        }
+        sendPending();
+      } else if (const auto found = connections.find(fd); found != connections.end()) {
+        const std::shared_ptr<Connection> connection = found->second;
+        if (events[index].events & (EPOLLHUP | EPOLLERR)) {
+          close(*connection);
+          continue;
+        }
+        if (events[index].events & EPOLLOUT) {
+          send(*connection);
+        }
+        if (events[index].events & EPOLLIN) {
+          receive(connection);
+        }
+        closeIfFinished(*connection);
+      }
+    }
+  }
+}
+
+void SessionServer::acceptConnections() {
+  for (;;) {
+    const int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      ::close(fd);
+      continue;
+    }
+    connections.emplace(fd, std::make_shared<Connection>(fd));
+  }
+}
+
+void SessionServer::receive(const std::shared_ptr<Connection>& connection) {
+  std::array<char, 1 << 16> chunk;
+  for (;;) {
+    const ssize_t count = recv(connection->fd, chunk.data(), chunk.size(), 0);
+    if (count > 0) {
+      connection->input.append(chunk.data(), count);
+      continue;
+    }
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      close(*connection);
+      return;
+    }
+    // End of input: the client may still be waiting for the answers.
+    connection->inputDone = count == 0;
+    break;
+  }
+
+  std::size_t begin = 0;
+  for (std::size_t end; (end = connection->input.find('\n', begin)) != std::string::npos; begin = end + 1) {
+    dispatch(connection, std::string_view(connection->input).substr(begin, end - begin));
+  }
+  connection->input.erase(0, begin);
+  if (connection->inputDone) {
+    // A last line without its '\n'.
+    dispatch(connection, connection->input);
+    connection->input.clear();
+    watch(*connection);
+  } else if (connection->input.size() > MaxLineBytes) {
+    close(*connection);
+  }
+}
+
+void SessionServer::dispatch(const std::shared_ptr<Connection>& connection, std::string_view line) {
+  std::string_view id;
+  if (!nextLine(line, id)) {
+    return;
+  }
+  const std::size_t idEnd = id.find_first_of(" \t\r");
+  std::string_view rest = id.substr(idEnd == std::string_view::npos ? id.size() : idEnd);
+  id = id.substr(0, idEnd);
+  // A bare id still gets its answer: invalid.
+  std::string_view command;
+  nextLine(rest, command);
+
+  std::shared_ptr<SessionEntry> entry;
+  {
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    std::shared_ptr<SessionEntry>& slot = sessions[std::string(id)];
+    if (!slot) {
+      slot = std::make_shared<SessionEntry>(std::string(id), threads, reportStatus);
+    }
+    entry = slot;
+    // Later requests with this id start a new session; the old one still answers what it was sent.
+    if (command == "end") {
+      sessions.erase(std::string(id));
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    ++connection->unanswered;
+  }
+
+  bool schedule = false;
+  {
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    entry->requests.push_back(Request{connection, std::string(command)});
+    schedule = !entry->scheduled;
+    entry->scheduled = true;
+  }
+  if (schedule) {
+    {
+      std::lock_guard<std::mutex> lock(readyMutex);
+      ready.push_back(std::move(entry));
+    }
+    readyChanged.notify_one();
+  }
+}
+
+void SessionServer::close(Connection& connection) {
+  {
+    std::lock_guard<std::mutex> lock(connection.mutex);
+    if (connection.closed) {
+      return;
+    }
+    connection.closed = true;
+    connection.output.clear();
+  }
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+  ::close(connection.fd);
+  connections.erase(connection.fd);
+}
+
+void SessionServer::closeIfFinished(Connection& connection) {
+  bool finished;
+  {
+    std::lock_guard<std::mutex> lock(connection.mutex);
+    finished = connection.inputDone && !connection.closed && connection.unanswered == 0 && connection.output.empty();
+  }
+  if (finished) {
+    close(connection);
+  }
+}
+
+// Polls for input until the client stops sending and for writability while output is queued.
+void SessionServer::watch(Connection& connection) {
+  epoll_event event{};
+  {
+    std::lock_guard<std::mutex> lock(connection.mutex);
+    event.events = (connection.inputDone ? 0u : std::uint32_t{EPOLLIN}) |
+                   (connection.awaitingWrite ? std::uint32_t{EPOLLOUT} : 0u);
+  }
+  event.data.fd = connection.fd;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+}
+
+void SessionServer::reply(const std::shared_ptr<Connection>& connection, const std::string& id,
+                          std::string_view output) {
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    --connection->unanswered;
+    if (connection->closed) {
+      return;
+    }
+    for (std::size_t begin = 0, end; begin < output.size(); begin = end + 1) {
+      end = output.find('\n', begin);
+      if (end == std::string_view::npos) {
+        end = output.size();
+      }
+      connection->output += id;
+      connection->output += ' ';
+      connection->output += output.substr(begin, end - begin);
+      connection->output += '\n';
+    }
+    wake = !connection->awaitingWrite;
+    connection->awaitingWrite = true;
+  }
+  if (wake) {
+    {
+      std::lock_guard<std::mutex> lock(pendingMutex);
+      pending.push_back(connection);
+    }
+    const std::uint64_t one = 1;
+    write(wakeFd, &one, sizeof(one));
+  }
+}
+
+void SessionServer::sendPending() {
+  std::vector<std::shared_ptr<Connection>> batch;
+  {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    batch.swap(pending);
+  }
+  for (const std::shared_ptr<Connection>& connection : batch) {
+    send(*connection);
+    closeIfFinished(*connection);
+  }
+}
+
+// Sends as much queued output as the socket takes; the rest waits for EPOLLOUT.
+void SessionServer::send(Connection& connection) {
+  std::unique_lock<std::mutex> lock(connection.mutex);
+  if (connection.closed) {
+    return;
+  }
+  std::size_t sent = 0;
+  while (sent < connection.output.size()) {
+    const ssize_t count = ::send(connection.fd, connection.output.data() + sent, connection.output.size() - sent,
+                                 MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    sent += count;
+  }
+  connection.output.erase(0, sent);
+  connection.awaitingWrite = !connection.output.empty();
+  lock.unlock();
+  watch(connection);
+}
+
+void SessionServer::work() {
+  VerdictCache verdictCache;
+  std::string output;
+  for (;;) {
+    std::shared_ptr<SessionEntry> entry;
+    {
+      std::unique_lock<std::mutex> lock(readyMutex);
+      readyChanged.wait(lock, [&] { return !ready.empty() || stopping; });
+      if (stopping) {
+        return;
+      }
+      entry = std::move(ready.front());
+      ready.pop_front();
+    }
+
+    entry->session.getPosition().setVerdictCache(&verdictCache);
+    std::unique_lock<std::mutex> lock(entry->mutex);
+    while (!entry->requests.empty()) {
+      const Request request = std::move(entry->requests.front());
+      entry->requests.pop_front();
+      lock.unlock();
+
+      output.clear();
+      if (request.line == "end") {
+        output = "ok\n";
+      } else {
+        entry->session.execute(request.line, output);
+      }
+      // Every request is answered, so a client can tell an unrecognized command from one still running.
+      if (output.empty()) {
+        appendVerdict(Verdict::Invalid, output);
+      }
+      reply(request.connection, entry->id, output);
+      lock.lock();
+    }
+    entry->scheduled = false;
+  }
+}
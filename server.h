@@ -0,0 +1,110 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "session.h"
+
+// Daemon mode: many games in one long-running process, reached over a Unix domain socket. A request
+// line is "<session id> <command>", the command being any line of the file protocol; every line of its
+// output comes back as "<session id> <line>", and "<session id> end" drops the session. A request with
+// no command, or one that is not a command, is answered "<session id> invalid". Sessions are created on
+// first use and shared by all connections.
+//
+// One thread runs an epoll loop over the listening socket, the connections and a wake-up eventfd; a
+// fixed pool of workers runs the commands. A session is on at most one worker at a time and runs its
+// commands in arrival order; commands of different sessions may be answered in any order. Every session
+// runs perft and go on `threads` threads and, with `reportStatus`, answers B and M with the game status.
+class SessionServer {
+ public:
+  // Longest request line; a connection sending a longer one is dropped.
+  static constexpr std::size_t MaxLineBytes = std::size_t{1} << 16;
+
+  SessionServer(std::string path, int workers, int threads = 1, bool reportStatus = false);
+  ~SessionServer();
+  SessionServer(const SessionServer&) = delete;
+  SessionServer& operator=(const SessionServer&) = delete;
+
+  // Serves until a system call on the event loop fails, then returns false; false at once if the socket
+  // could not be set up.
+  bool run();
+
+ private:
+  struct Connection {
+    explicit Connection(int fd) : fd(fd) {}
+
+    int fd;
+    // Event loop only: received bytes not yet split into lines, and whether the client has stopped sending.
+    std::string input;
+    bool inputDone = false;
+
+    std::mutex mutex;
+    std::string output;
+    // Requests dispatched but not replied to; a connection whose input is done closes once this is zero
+    // and its output has gone out.
+    std::size_t unanswered = 0;
+    bool closed = false;
+    bool awaitingWrite = false;
+  };
+
+  struct Request {
+    std::shared_ptr<Connection> connection;
+    std::string line;
+  };
+
+  struct SessionEntry {
+    SessionEntry(std::string id, int threads, bool reportStatus)
+        : id(std::move(id)), session(nullptr, threads, reportStatus) {}
+
+    std::string id;
+    // Only touched by the worker the entry is scheduled on.
+    Session session;
+
+    std::mutex mutex;
+    std::deque<Request> requests;
+    bool scheduled = false;
+  };
+
+  bool listen();
+  void acceptConnections();
+  void receive(const std::shared_ptr<Connection>& connection);
+  void dispatch(const std::shared_ptr<Connection>& connection, std::string_view line);
+  void close(Connection& connection);
+  void closeIfFinished(Connection& connection);
+  void watch(Connection& connection);
+  void reply(const std::shared_ptr<Connection>& connection, const std::string& id, std::string_view output);
+  void sendPending();
+  void send(Connection& connection);
+  void work();
+
+  std::string path;
+  int workerCount;
+  int threads;
+  bool reportStatus;
+  int listenFd = -1;
+  int epollFd = -1;
+  int wakeFd = -1;
+  // Event loop only.
+  std::unordered_map<int, std::shared_ptr<Connection>> connections;
+
+  std::mutex sessionsMutex;
+  std::unordered_map<std::string, std::shared_ptr<SessionEntry>> sessions;
+
+  std::mutex readyMutex;
+  std::condition_variable readyChanged;
+  std::deque<std::shared_ptr<SessionEntry>> ready;
+  bool stopping = false;
+
+  // Connections with output for the event loop to send.
+  std::mutex pendingMutex;
+  std::vector<std::shared_ptr<Connection>> pending;
+
+  std::vector<std::thread> workers;
+};
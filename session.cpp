@@ -0,0 +1,228 @@
+#include "session.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+// The number after a command word, blanks skipped; 0 when there is none or it does not fit.
+unsigned long parseCount(std::string_view text) {
+  while (!text.empty() && (text[0] == ' ' || text[0] == '\t')) {
+    text.remove_prefix(1);
+  }
+  unsigned long count = 0;
+  std::from_chars(text.data(), text.data() + text.size(), count);
+  return count;
+}
+
+// 16 hex digits, bit n being square n of the B line.
+void appendMask(Bitboard mask, std::string& out) {
+  char digits[16];
+  for (int index = 15; index >= 0; --index, mask >>= 4) {
+    digits[index] = "0123456789abcdef"[mask & 15];
+  }
+  out.append(digits, sizeof(digits));
+}
+
+// "A": "white <mask>", "black <mask>" and "attackers" followed by the 64 attacker masks, a8 first.
+// "A e4": the attackers of one square.
+void appendAttacks(Position& position, std::string_view square, std::string& out) {
+  while (!square.empty() && std::isspace(static_cast<unsigned char>(square.back()))) {
+    square.remove_suffix(1);
+  }
+  while (!square.empty() && (square[0] == ' ' || square[0] == '\t')) {
+    square.remove_prefix(1);
+  }
+  if (!square.empty() && (square.size() != 2 || square[0] < 'a' || square[0] > 'h' || square[1] < '1' ||
+                          square[1] > '8')) {
+    appendVerdict(Verdict::Invalid, out);
+    return;
+  }
+  const AttackSets sets = position.attackSets();
+  if (!square.empty()) {
+    appendMask(sets.attackers[toSquare('8' - square[1], square[0] - 'a')], out);
+    out += '\n';
+    return;
+  }
+  out += "white ";
+  appendMask(sets.attacked[static_cast<int>(Color::White)], out);
+  out += "\nblack ";
+  appendMask(sets.attacked[static_cast<int>(Color::Black)], out);
+  out += "\nattackers";
+  for (Bitboard attackers : sets.attackers) {
+    out += ' ';
+    appendMask(attackers, out);
+  }
+  out += '\n';
+}
+
+// "depth N" and "movetime MS" in any order; false for anything else or when neither is there.
+bool parseSearchLimits(std::string_view text, SearchLimits& limits) {
+  std::istringstream words{std::string(text)};
+  std::string word;
+  unsigned long value = 0;
+  while (words >> word) {
+    if ((word != "depth" && word != "movetime") || !(words >> value) || value == 0) {
+      return false;
+    }
+    if (word == "depth") {
+      limits.depth = static_cast<int>(std::min<unsigned long>(value, MaxSearchDepth));
+    } else {
+      limits.movetime = value;
+    }
+  }
+  return limits.depth > 0 || limits.movetime > 0;
+}
+
+void Session::execute(std::string_view line, std::string& out) {
+  if (line.empty()) {
+    return;
+  }
+
+  const bool takeback = line == "U" || line.rfind("takeback", 0) == 0;
+  // Lines answered through appendResult() are counted there.
+  if constexpr (StatsEnabled) {
+    if (line[0] != 'B' && line[0] != 'M' && !takeback) {
+      countCommand(line == "print" ? CommandKind::Print : CommandKind::Other);
+    }
+  }
+
+  if (line[0] == 'B') {
+    appendResult(CommandKind::Board, position.loadBoard(line.substr(1)), out);
+  } else if (line[0] == 'M') {
+    appendResult(CommandKind::Move, position.playMove(line.substr(1)), out);
+  } else if (line == "print") {
+    position.print(out);
+  } else if (line[0] == 'A') {
+    appendAttacks(position, line.substr(1), out);
+  } else if (line == "status") {
+    out += statusText(position.status());
+    out += '\n';
+  } else if (takeback) {
+    const unsigned long plies = line == "U" ? 1 : parseCount(line.substr(8));
+    appendResult(CommandKind::Other, position.takeBack(plies), out);
+  } else if (line.rfind("go", 0) == 0 && (line.size() == 2 || line[2] == ' ')) {
+    SearchLimits limits;
+    limits.threads = threads;
+    if (!parseSearchLimits(line.substr(2), limits)) {
+      appendVerdict(Verdict::Invalid, out);
+      return;
+    }
+    if (!searcher) {
+      searcher = std::make_unique<Searcher>();
+    }
+    searcher->search(position.getBoard(), position.getSideToMove(), limits, out);
+  } else if (line.rfind("perft", 0) == 0) {
+    const unsigned long depth = parseCount(line.substr(5));
+    if (depth < 1) {
+      appendVerdict(Verdict::Invalid, out);
+      return;
+    }
+    std::ostringstream divide;
+    position.perftDivide(static_cast<int>(depth), threads, divide);
+    out += divide.str();
+  }
+}
+
+void Session::appendResult(CommandKind command, Verdict verdict, std::string& out) {
+  countCommand(verdict == Verdict::Invalid ? CommandKind::Invalid : command);
+  if (reportStatus && verdict != Verdict::Invalid) {
+    out += statusText(position.status());
+    out += '\n';
+  } else {
+    appendVerdict(verdict, out);
+  }
+}
+
+ShardedRunner::ShardedRunner(int jobs, bool reportStatus)
+    : jobs(jobs),
+      reportStatus(reportStatus),
+      maxInFlight(4 * static_cast<std::size_t>(jobs)),
+      outputs(maxInFlight),
+      ready(maxInFlight) {}
+
+void ShardedRunner::run(LineReader& in, OutputWriter& out) {
+  this->out = &out;
+  std::vector<VerdictCache> verdictCaches(jobs);
+  std::vector<std::thread> workers;
+  for (VerdictCache& verdictCache : verdictCaches) {
+    workers.emplace_back(&ShardedRunner::work, this, std::ref(verdictCache));
+  }
+
+  Shard shard{0, {}, {}};
+  std::string_view line;
+  while (in.next(line)) {
+    if (shard.text().size() >= ShardBytes && isFullBoardLine(line)) {
+      const std::size_t index = shard.index;
+      submit(std::move(shard));
+      shard = Shard{index + 1, {}, {}};
+    }
+    if (!in.isMapped()) {
+      shard.copied += line;
+      shard.copied += '\n';
+    } else if (!shard.mapped.data()) {
+      shard.mapped = line;
+    } else {
+      shard.mapped = std::string_view(shard.mapped.data(), line.data() + line.size() - shard.mapped.data());
+    }
+  }
+  submit(std::move(shard));
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    inputDone = true;
+  }
+  changed.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+void ShardedRunner::submit(Shard&& shard) {
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [&] { return submitted - nextToWrite < maxInFlight; });
+  queue.push_back(std::move(shard));
+  ++submitted;
+  lock.unlock();
+  changed.notify_all();
+}
+
+void ShardedRunner::work(VerdictCache& verdictCache) {
+  for (;;) {
+    Shard shard;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [&] { return !queue.empty() || inputDone; });
+      if (queue.empty()) {
+        return;
+      }
+      shard = std::move(queue.front());
+      queue.pop_front();
+    }
+
+    Session session(&verdictCache, 1, reportStatus);
+    std::string output;
+    std::string_view text = shard.text();
+    std::string_view line;
+    while (nextLine(text, line)) {
+      session.execute(line, output);
+    }
+    finish(shard.index, std::move(output));
+  }
+}
+
+void ShardedRunner::finish(std::size_t index, std::string&& output) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    outputs[index % maxInFlight] = std::move(output);
+    ready[index % maxInFlight] = true;
+    while (ready[nextToWrite % maxInFlight]) {
+      out->write(std::move(outputs[nextToWrite % maxInFlight]));
+      ready[nextToWrite % maxInFlight] = false;
+      ++nextToWrite;
+    }
+  }
+  changed.notify_all();
+}
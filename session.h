@@ -0,0 +1,90 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "chess.h"
+#include "input.h"
+#include "output.h"
+#include "search.h"
+
+inline void appendVerdict(Verdict verdict, std::string& out) {
+  out += verdictText(verdict);
+  out += '\n';
+}
+
+// The line protocol over one Position: B, M, U / takeback N, perft N, A [square], status, print and
+// go depth N / go movetime MS (both may be given). Blank lines and lines that are no command produce no output.
+// Perft and go use `threads` threads. With `reportStatus`, B, M and takeback answer with statusText()
+// rather than the plain check verdict, so mate and stalemate come out with no separate status line.
+class Session {
+ public:
+  explicit Session(VerdictCache* verdictCache = nullptr, int threads = 1, bool reportStatus = false)
+      : position(verdictCache), threads(threads), reportStatus(reportStatus) {}
+
+  // Runs one line, already stripped of leading whitespace, and appends its output to `out`.
+  void execute(std::string_view line, std::string& out);
+
+  // The answer to a B, M or takeback line (`command` is Board, Move or Other) that came out as `verdict`.
+  void appendResult(CommandKind command, Verdict verdict, std::string& out);
+
+  Position& getPosition() { return position; }
+
+ private:
+  Position position;
+  int threads;
+  bool reportStatus;
+  // Made by the first go, so that sessions that never search allocate no table.
+  std::unique_ptr<Searcher> searcher;
+};
+
+// A valid B line sets all 64 squares: nothing before it affects anything after it.
+inline bool isFullBoardLine(std::string_view line) { return line[0] == 'B' && isValidBoardString(line.substr(1)); }
+
+// Runs the commands in `in` on `jobs` threads. The input is cut into shards of about ShardBytes at full
+// B lines, each shard runs on its own Session, and a reorder buffer writes the output to `out` in input
+// order. Perft inside a shard is single-threaded.
+class ShardedRunner {
+ public:
+  static constexpr std::size_t ShardBytes = std::size_t{1} << 20;
+
+  explicit ShardedRunner(int jobs, bool reportStatus = false);
+
+  void run(LineReader& in, OutputWriter& out);
+
+ private:
+  // Lines of a mapped input stay where they are; lines read through a buffer are copied into `copied`.
+  struct Shard {
+    std::size_t index;
+    std::string_view mapped;
+    std::string copied;
+
+    std::string_view text() const { return mapped.data() ? mapped : std::string_view(copied); }
+  };
+
+  void submit(Shard&& shard);
+  void work(VerdictCache& verdictCache);
+  void finish(std::size_t index, std::string&& output);
+
+  int jobs;
+  bool reportStatus;
+  // Shards read but not yet written; the reader waits while this many are out, which bounds memory.
+  std::size_t maxInFlight;
+  OutputWriter* out = nullptr;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<Shard> queue;
+  bool inputDone = false;
+  // Reorder buffer: the output of shard i waits in slot i % maxInFlight until every earlier one is written.
+  std::vector<std::string> outputs;
+  std::vector<bool> ready;
+  std::size_t nextToWrite = 0;
+  std::size_t submitted = 0;
+};
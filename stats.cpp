@@ -0,0 +1,157 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+std::mutex StatsMutex;
+std::vector<const Stats*> LiveStats;
+StatsTotals RetiredStats;
+
+// Where tick counting started, to convert ticks to nanoseconds at report time.
+const std::uint64_t StartTicks = statsTicks();
+const std::chrono::steady_clock::time_point StartTime = std::chrono::steady_clock::now();
+
+constexpr std::array<const char*, CommandKinds> CommandNames = {"board", "move", "print", "invalid", "other"};
+constexpr std::array<const char*, Stages> StageNames = {"parse", "validate", "check", "output"};
+
+void addStats(const Stats& stats, StatsTotals& totals) {
+  for (std::size_t kind = 0; kind < CommandKinds; ++kind) {
+    totals.commands[kind] += stats.commands[kind].load(std::memory_order_relaxed);
+  }
+  for (std::size_t stage = 0; stage < Stages; ++stage) {
+    for (std::size_t bucket = 0; bucket < LatencyBuckets; ++bucket) {
+      totals.latency[stage][bucket] += stats.latency[stage][bucket].load(std::memory_order_relaxed);
+    }
+    totals.ticks[stage] += stats.ticks[stage].load(std::memory_order_relaxed);
+  }
+  totals.inCheckCalls += stats.inCheckCalls.load(std::memory_order_relaxed);
+  totals.piecesExamined += stats.piecesExamined.load(std::memory_order_relaxed);
+  totals.verdictCacheHits += stats.verdictCacheHits.load(std::memory_order_relaxed);
+  totals.verdictCacheMisses += stats.verdictCacheMisses.load(std::memory_order_relaxed);
+}
+
+// A thread's counts, listed while it runs and folded into RetiredStats when it ends.
+struct ThreadStats {
+  ThreadStats() {
+    std::lock_guard<std::mutex> lock(StatsMutex);
+    LiveStats.push_back(&stats);
+  }
+  ~ThreadStats() {
+    std::lock_guard<std::mutex> lock(StatsMutex);
+    addStats(stats, RetiredStats);
+    LiveStats.erase(std::find(LiveStats.begin(), LiveStats.end(), &stats));
+  }
+
+  Stats stats;
+};
+
+Stats& threadStats() {
+  thread_local ThreadStats current;
+  return current.stats;
+}
+
+StatsTotals collectStats() {
+  std::lock_guard<std::mutex> lock(StatsMutex);
+  StatsTotals totals = RetiredStats;
+  for (const Stats* stats : LiveStats) {
+    addStats(*stats, totals);
+  }
+  return totals;
+}
+
+double nanosecondsPerTick() {
+  const double nanoseconds =
+      std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - StartTime).count();
+  const std::uint64_t ticks = statsTicks() - StartTicks;
+  return ticks ? nanoseconds / ticks : 1;
+}
+
+// Upper bound in nanoseconds of the bucket holding the given fraction of the calls.
+double percentile(const std::array<std::uint64_t, LatencyBuckets>& buckets, std::uint64_t calls, double fraction,
+                  double tickNanoseconds) {
+  std::uint64_t seen = 0;
+  for (std::size_t bucket = 0; bucket < LatencyBuckets; ++bucket) {
+    seen += buckets[bucket];
+    if (seen >= fraction * calls) {
+      return static_cast<double>(std::uint64_t{1} << bucket) * tickNanoseconds;
+    }
+  }
+  return 0;
+}
+
+StatsReporter::StatsReporter(bool json, double interval, std::ostream& out) : json(json), interval(interval), out(out) {
+  if (interval > 0) {
+    reporter = std::thread(&StatsReporter::run, this);
+  }
+}
+
+StatsReporter::~StatsReporter() {
+  if (reporter.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    changed.notify_all();
+    reporter.join();
+  }
+  reportStats(collectStats(), json, out);
+}
+
+void StatsReporter::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!changed.wait_for(lock, std::chrono::duration<double>(interval), [&] { return stopping; })) {
+    reportStats(collectStats(), json, out);
+  }
+}
+
+void reportStats(const StatsTotals& totals, bool json, std::ostream& out) {
+  const double tickNanoseconds = nanosecondsPerTick();
+  if (json) {
+    out << "{\"commands\": {";
+    for (std::size_t kind = 0; kind < CommandKinds; ++kind) {
+      out << (kind ? ", \"" : "\"") << CommandNames[kind] << "\": " << totals.commands[kind];
+    }
+    out << "}, \"in_check_calls\": " << totals.inCheckCalls << ", \"pieces_examined\": " << totals.piecesExamined
+        << ", \"verdict_cache\": {\"hits\": " << totals.verdictCacheHits << ", \"misses\": " << totals.verdictCacheMisses
+        << "}, \"stages\": {";
+  } else {
+    out << "commands:";
+    for (std::size_t kind = 0; kind < CommandKinds; ++kind) {
+      out << (kind ? ", " : " ") << CommandNames[kind] << ' ' << totals.commands[kind];
+    }
+    out << "\nInCheck: " << totals.inCheckCalls << " calls, " << totals.piecesExamined << " pieces examined\n";
+    out << "verdict cache: " << totals.verdictCacheHits << " hits, " << totals.verdictCacheMisses << " misses\n";
+  }
+
+  for (std::size_t stage = 0; stage < Stages; ++stage) {
+    const std::array<std::uint64_t, LatencyBuckets>& buckets = totals.latency[stage];
+    std::uint64_t calls = 0;
+    for (std::uint64_t count : buckets) {
+      calls += count;
+    }
+    const double mean = calls ? totals.ticks[stage] * tickNanoseconds / calls : 0;
+    const double p50 = percentile(buckets, calls, 0.5, tickNanoseconds);
+    const double p99 = percentile(buckets, calls, 0.99, tickNanoseconds);
+    if (json) {
+      out << (stage ? ", \"" : "\"") << StageNames[stage] << "\": {\"calls\": " << calls << ", \"mean_ns\": " << mean
+          << ", \"p50_ns\": " << p50 << ", \"p99_ns\": " << p99 << ", \"histogram\": [";
+      bool first = true;
+      for (std::size_t bucket = 0; bucket < LatencyBuckets; ++bucket) {
+        if (buckets[bucket]) {
+          out << (first ? "[" : ", [") << static_cast<double>(std::uint64_t{1} << bucket) * tickNanoseconds << ", "
+              << buckets[bucket] << "]";
+          first = false;
+        }
+      }
+      out << "]}";
+    } else {
+      out << StageNames[stage] << ": " << calls << " calls, mean " << mean << " ns, p50 < " << p50 << " ns, p99 < "
+          << p99 << " ns\n";
+    }
+  }
+  if (json) {
+    out << "}}\n";
+  }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// Hot-path instrumentation, compiled in with -DCHESS_STATS. Without it every hook below is an empty inline
+// function or an empty object, and the fast path is the same code as before.
+#if defined(CHESS_STATS)
+constexpr bool StatsEnabled = true;
+#else
+constexpr bool StatsEnabled = false;
+#endif
+
+// B, M and print lines; B and M lines answered "invalid" count as Invalid only. Other covers the rest.
+enum class CommandKind : std::uint8_t { Board, Move, Print, Invalid, Other };
+constexpr std::size_t CommandKinds = 5;
+
+// Parse: B board decoding and M text to Move. Validate: piece lookup, the piece rules and the own-king test.
+// Check: the check verdict. Output: the writer thread's write calls.
+enum class Stage : std::uint8_t { Parse, Validate, Check, Output };
+constexpr std::size_t Stages = 4;
+
+// Latency bucket b counts durations below 2^b ticks and at least 2^(b-1).
+constexpr std::size_t LatencyBuckets = 48;
+
+// Counts of one thread. Only that thread adds to them; a report taken meanwhile may lag by a few counts.
+struct Stats {
+  std::array<std::atomic<std::uint64_t>, CommandKinds> commands{};
+  std::array<std::array<std::atomic<std::uint64_t>, LatencyBuckets>, Stages> latency{};
+  std::array<std::atomic<std::uint64_t>, Stages> ticks{};
+  std::atomic<std::uint64_t> inCheckCalls{0};
+  std::atomic<std::uint64_t> piecesExamined{0};
+  std::atomic<std::uint64_t> verdictCacheHits{0};
+  std::atomic<std::uint64_t> verdictCacheMisses{0};
+};
+
+// The sum over all threads, live and finished.
+struct StatsTotals {
+  std::array<std::uint64_t, CommandKinds> commands{};
+  std::array<std::array<std::uint64_t, LatencyBuckets>, Stages> latency{};
+  std::array<std::uint64_t, Stages> ticks{};
+  std::uint64_t inCheckCalls = 0;
+  std::uint64_t piecesExamined = 0;
+  std::uint64_t verdictCacheHits = 0;
+  std::uint64_t verdictCacheMisses = 0;
+};
+
+Stats& threadStats();
+StatsTotals collectStats();
+// Text, or one JSON object per call when `json` is set.
+void reportStats(const StatsTotals& totals, bool json, std::ostream& out);
+
+// Reports collectStats() to `out` every `interval` seconds (never when it is 0) and once more when destroyed.
+class StatsReporter {
+ public:
+  StatsReporter(bool json, double interval, std::ostream& out);
+  ~StatsReporter();
+  StatsReporter(const StatsReporter&) = delete;
+  StatsReporter& operator=(const StatsReporter&) = delete;
+
+ private:
+  void run();
+
+  bool json;
+  double interval;
+  std::ostream& out;
+  std::mutex mutex;
+  std::condition_variable changed;
+  bool stopping = false;
+  std::thread reporter;
+};
+
+// A single writer per counter, so a relaxed load and store is enough and takes no locked instruction.
+inline void addStat(std::atomic<std::uint64_t>& counter, std::uint64_t count = 1) {
+  counter.store(counter.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+}
+
+inline void countCommand(CommandKind kind) {
+  if constexpr (StatsEnabled) {
+    addStat(threadStats().commands[static_cast<int>(kind)]);
+  }
+}
+
+inline void countInCheck() {
+  if constexpr (StatsEnabled) {
+    addStat(threadStats().inCheckCalls);
+  }
+}
+
+inline void countPiecesExamined(std::uint64_t count) {
+  if constexpr (StatsEnabled) {
+    addStat(threadStats().piecesExamined, count);
+  }
+}
+
+inline void countVerdictCache(bool hit) {
+  if constexpr (StatsEnabled) {
+    addStat(hit ? threadStats().verdictCacheHits : threadStats().verdictCacheMisses);
+  }
+}
+
+// The time stamp counter where there is one, nanoseconds otherwise; reports convert ticks to nanoseconds.
+inline std::uint64_t statsTicks() {
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+// Adds the time from construction to destruction to a stage's histogram.
+class StageTimer {
+ public:
+  explicit StageTimer(Stage stage) : stage(stage) {
+    if constexpr (StatsEnabled) {
+      start = statsTicks();
+    }
+  }
+  ~StageTimer() {
+    if constexpr (StatsEnabled) {
+      const std::uint64_t elapsed = statsTicks() - start;
+      Stats& stats = threadStats();
+      const std::size_t bucket = elapsed ? 64 - __builtin_clzll(elapsed) : 0;
+      addStat(stats.latency[static_cast<int>(stage)][bucket < LatencyBuckets ? bucket : LatencyBuckets - 1]);
+      addStat(stats.ticks[static_cast<int>(stage)], elapsed);
+    }
+  }
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+
+ private:
+  Stage stage;
+  std::uint64_t start = 0;
+};